@@ -0,0 +1,324 @@
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <functional>
+#include <mutex>
+#include <chrono>
+#include "sat_solver.hpp"
+
+#ifndef BACKBONE
+#define BACKBONE
+
+using namespace std;
+
+/**
+ * @brief Compute the backbone of the formula in a solver, over a set of variables: the literals true in every model.
+ *
+ * The first model gives a candidate literal per variable. A candidate is tested by solving under the assumption of its negation:
+ * UNSAT confirms it, and a model drops every candidate it falsifies, as well as those it can flip (no clause has them as its only true literal,
+ * and no cardinality constraint contains them).
+ * Confirmed literals are added as unit clauses, so that the candidates they imply are found assigned at level 0 without a test,
+ * and a literal confirmed by a test also confirms the candidates it implies through binary clauses. Learnt clauses are kept from one test to the next.
+ *
+ * Tests may be spread over several workers, each with its own solver; the candidates and the confirmed literals are shared.
+ *
+ * @tparam Solver a `BasicSATSolver`
+ */
+template <typename Solver>
+class BackboneFinder
+{
+    using VariableID = typename Solver::VariableID;
+    using ClauseID = typename Solver::ClauseID;
+
+public:
+    enum Outcome
+    {
+        OPEN,
+        TESTING,
+        // Backbone literals, by the way they are confirmed
+        ASSUMPTION,
+        UNIT,
+        BINARY,
+        // Dropped by a model, in which the literal is false or can be flipped
+        MODEL,
+        FLIPPED
+    };
+
+    struct Candidate
+    {
+        size_t name;
+        // Value in the first model
+        bool value;
+        Outcome outcome = OPEN;
+        // Spent in the tests of this literal
+        std::chrono::nanoseconds time{0};
+
+        bool is_backbone() const
+        {
+            return outcome == ASSUMPTION || outcome == UNIT || outcome == BINARY;
+        }
+    };
+
+private:
+    Solver &sat_solver;
+    vector<size_t> names;
+
+    mutex candidates_mutex;
+    vector<Candidate> candidates;
+    // Original name -> index in `candidates`
+    unordered_map<size_t, size_t> candidate_of;
+    // The candidates before this one are not open.
+    size_t next_candidate = 0;
+    // Confirmed literals, in the form of the input of `initiate`, for each worker to add as unit clauses
+    vector<pair<bool, size_t>> confirmed;
+    size_t test_num = 0;
+    bool interrupted = false;
+
+public:
+    /**
+     * @param names original names of the variables. They need not appear in the formula; if they do not, they are free.
+     */
+    BackboneFinder(Solver &sat_solver, vector<size_t> names) : sat_solver(sat_solver), names(std::move(names)) {}
+
+    /**
+     * @param worker_num the number of solvers testing candidates, each on its own thread. The first one is the solver of the finder;
+     * the others are given the formula by `prepare`.
+     * @return true SAT, the backbone is in `get_candidates`
+     * @return false UNSAT: there is no model, so no backbone
+     * @return nullopt interrupted by the terminate callback of a solver
+     */
+    optional<bool> find(size_t worker_num, const function<void(Solver &)> &prepare)
+    {
+        auto result = sat_solver.solve({});
+        if (!result.has_value() || !result.value())
+            return result;
+
+        for (auto name : names)
+        {
+            auto res = sat_solver.OriginalName2varID.find(name);
+            if (res == sat_solver.OriginalName2varID.end() || candidate_of.count(name))
+                continue;
+            candidate_of[name] = candidates.size();
+            candidates.push_back({name, sat_solver.get_variable(res->second).value == TRUE});
+        }
+        drop_by_model(sat_solver, variable_ids(sat_solver));
+
+        auto run_worker = [&](size_t worker, size_t, size_t)
+        {
+            if (worker == 0)
+            {
+                work(sat_solver);
+                return;
+            }
+            ostream null_log(nullptr);
+            Solver worker_solver(null_log);
+            prepare(worker_solver);
+            work(worker_solver);
+        };
+        parallel_for(worker_num, worker_num, run_worker);
+        if (interrupted)
+            return nullopt;
+        return true;
+    }
+
+    const vector<Candidate> &get_candidates() const
+    {
+        return candidates;
+    }
+
+    size_t get_test_num() const
+    {
+        return test_num;
+    }
+
+private:
+    /**
+     * @brief The variable IDs of the candidates in `solver`, which has the same formula as the solver of the finder.
+     *
+     */
+    vector<VariableID> variable_ids(Solver &solver)
+    {
+        vector<VariableID> ids;
+        for (auto &candidate : candidates)
+            ids.push_back(solver.OriginalName2varID.at(candidate.name));
+        return ids;
+    }
+
+    bool is_undecided(size_t index)
+    {
+        return candidates[index].outcome == OPEN || candidates[index].outcome == TESTING;
+    }
+
+    /**
+     * @brief The next open candidate, marked as being tested. nullopt once all the candidates are decided or are being tested.
+     *
+     */
+    optional<size_t> pick()
+    {
+        while (next_candidate < candidates.size() && candidates[next_candidate].outcome != OPEN)
+            next_candidate++;
+        if (interrupted || next_candidate == candidates.size())
+            return nullopt;
+        candidates[next_candidate].outcome = TESTING;
+        return next_candidate++;
+    }
+
+    void confirm(size_t index, Outcome outcome)
+    {
+        candidates[index].outcome = outcome;
+        confirmed.push_back({candidates[index].value, candidates[index].name});
+    }
+
+    /**
+     * @brief Whether the literal of `variableID`, true in the model of `solver`, can be flipped without falsifying any clause or constraint.
+     *
+     */
+    bool is_flippable(Solver &solver, VariableID variableID, bool value)
+    {
+        // Flipping may exceed the bound of a cardinality constraint.
+        if (!solver.cardinality_propagator.get_occurrences(variableID).empty())
+            return false;
+        for (auto clauseID : solver.get_variable(variableID).clauses)
+        {
+            auto &clause = solver.get_clause(clauseID);
+            if (clause.get_literals().at(variableID).get_literal_type() == value && clause.get_literals_by_value(TRUE).size() == 1)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Drop the undecided candidates which are false, or can be flipped, in the model of `solver`.
+     *
+     */
+    void drop_by_model(Solver &solver, const vector<VariableID> &ids)
+    {
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            if (!is_undecided(i))
+                continue;
+            bool value = solver.get_variable(ids[i]).value == TRUE;
+            if (value != candidates[i].value)
+                candidates[i].outcome = MODEL;
+            else if (is_flippable(solver, ids[i], value))
+                candidates[i].outcome = FLIPPED;
+        }
+    }
+
+    /**
+     * @brief Confirm the undecided candidates assigned at level 0 in `solver`, from the trail position `from`.
+     *
+     * @return the end of the level-0 trail
+     */
+    size_t confirm_units(Solver &solver, size_t from)
+    {
+        for (; from < solver.implication_graph.size(); from++)
+        {
+            auto var_id = solver.implication_graph[from].variableID;
+            auto res = candidate_of.find(solver.VarID2originalName[var_id]);
+            if (res == candidate_of.end() || !is_undecided(res->second))
+                continue;
+            claim((solver.get_variable(var_id).value == TRUE) == candidates[res->second].value);
+            confirm(res->second, UNIT);
+        }
+        return from;
+    }
+
+    /**
+     * @brief Confirm the undecided candidates implied by the backbone literal of `root` through binary clauses, transitively.
+     *
+     */
+    void confirm_implied(Solver &solver, VariableID root, bool root_value)
+    {
+        vector<pair<VariableID, bool>> stack{{root, root_value}};
+        unordered_set<VariableID> visited{root};
+        while (!stack.empty())
+        {
+            auto literal = stack.back();
+            stack.pop_back();
+            for (auto clauseID : solver.get_variable(literal.first).clauses)
+            {
+                auto &literals = solver.get_clause(clauseID).get_literals();
+                // The other literal of a binary clause with the negation of `literal` is implied.
+                if (literals.size() != 2 || literals.at(literal.first).get_literal_type() == literal.second)
+                    continue;
+                for (auto &varID_literal : literals)
+                {
+                    if (!visited.insert(varID_literal.first).second)
+                        continue;
+                    bool value = varID_literal.second.get_literal_type();
+                    stack.push_back({varID_literal.first, value});
+                    auto res = candidate_of.find(solver.VarID2originalName[varID_literal.first]);
+                    if (res == candidate_of.end() || !is_undecided(res->second))
+                        continue;
+                    claim(candidates[res->second].value == value);
+                    confirm(res->second, BINARY);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Test candidates on `solver` until none is left open.
+     *
+     */
+    void work(Solver &solver)
+    {
+        auto ids = variable_ids(solver);
+        // The confirmed literals already added to `solver`, and the level-0 assignments of `solver` already seen
+        size_t added_num = 0;
+        size_t unit_pos = 0;
+        while (true)
+        {
+            vector<vector<pair<bool, size_t>>> units;
+            size_t index;
+            {
+                lock_guard<mutex> guard(candidates_mutex);
+                auto picked = pick();
+                if (!picked.has_value())
+                    return;
+                index = picked.value();
+                for (; added_num < confirmed.size(); added_num++)
+                    units.push_back({confirmed[added_num]});
+            }
+            // Backtracks to level 0. The confirmed literals hold in every model, so their propagation cannot conflict.
+            solver.initiate(units.begin(), units.end());
+            claim(!solver.propagate().has_value());
+            {
+                lock_guard<mutex> guard(candidates_mutex);
+                unit_pos = confirm_units(solver, unit_pos);
+                if (candidates[index].outcome != TESTING)
+                    continue;
+            }
+
+            auto &candidate = candidates[index];
+            auto start = std::chrono::steady_clock::now();
+            auto result = solver.solve({{!candidate.value, candidate.name}});
+            auto time = std::chrono::steady_clock::now() - start;
+
+            lock_guard<mutex> guard(candidates_mutex);
+            test_num++;
+            candidate.time += time;
+            if (!result.has_value())
+            {
+                interrupted = true;
+                return;
+            }
+            if (result.value())
+            {
+                claim(!candidate.is_backbone());
+                drop_by_model(solver, ids);
+            }
+            else
+            {
+                claim(candidate.outcome != MODEL && candidate.outcome != FLIPPED);
+                if (candidate.outcome == TESTING)
+                    confirm(index, ASSUMPTION);
+                confirm_implied(solver, ids[index], candidate.value);
+            }
+        }
+    }
+};
+
+#endif
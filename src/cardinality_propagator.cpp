@@ -0,0 +1,92 @@
+#include "sat_solver.hpp"
+#include "policy_registry.hpp"
+
+template <typename Policies>
+void BasicSATSolver<Policies>::CardinalityPropagator::add(const vector<pair<VariableID, bool>> &literals, size_t bound)
+{
+    size_t constraint_id = constraints.size();
+    Constraint constraint{literals, bound};
+    for (auto &literal : literals)
+    {
+        if (literal.first >= occurrences.size())
+        {
+            occurrences.resize(literal.first + 1);
+            assigned_at.resize(literal.first + 1, 0);
+        }
+        occurrences[literal.first].push_back({constraint_id, literal.second});
+        auto value = sat_solver.get_variable(literal.first).value;
+        if (value != UNASSIGNED && (value == TRUE) == literal.second)
+            constraint.true_num++;
+    }
+    // Propagated at the next fixpoint, at level 0
+    if (constraint.true_num >= bound)
+    {
+        constraint.queued = true;
+        pending.push_back(constraint_id);
+    }
+    constraints.push_back(std::move(constraint));
+}
+
+template <typename Policies>
+auto BasicSATSolver<Policies>::CardinalityPropagator::propagate() -> optional<ClauseID>
+{
+    auto is_true = [&](const pair<VariableID, bool> &literal)
+    {
+        auto value = sat_solver.get_variable(literal.first).value;
+        return value != UNASSIGNED && (value == TRUE) == literal.second;
+    };
+    auto explain = [&](const vector<pair<VariableID, bool>> &literals)
+    {
+        auto clause_id = sat_solver.add_implied_clause(literals);
+        // The number of literals bounds the LBD.
+        sat_solver.reduction_policy.on_learnt(clause_id, literals.size(), literals.size());
+        return clause_id;
+    };
+
+    while (!pending.empty())
+    {
+        auto &constraint = constraints[pending.back()];
+        vector<pair<VariableID, bool>> true_literals;
+        for (auto &literal : constraint.literals)
+            if (is_true(literal))
+                true_literals.push_back(literal);
+
+        if (constraint.true_num > constraint.bound)
+        {
+            // The latest true literals, so that the conflict involves the current decision level.
+            // The constraint stays pending: it is checked again after backjumping.
+            partial_sort(true_literals.begin(), true_literals.begin() + constraint.bound + 1, true_literals.end(),
+                         [&](const pair<VariableID, bool> &lhs, const pair<VariableID, bool> &rhs)
+                         { return assigned_at[lhs.first] > assigned_at[rhs.first]; });
+            true_literals.resize(constraint.bound + 1);
+            vector<pair<VariableID, bool>> conflict_clause;
+            for (auto &literal : true_literals)
+                conflict_clause.push_back({literal.first, !literal.second});
+            return explain(conflict_clause);
+        }
+
+        constraint.queued = false;
+        pending.pop_back();
+        if (constraint.true_num < constraint.bound)
+            continue;
+
+        vector<pair<VariableID, bool>> reason;
+        for (auto &literal : true_literals)
+            reason.push_back({literal.first, !literal.second});
+        for (auto &literal : constraint.literals)
+        {
+            if (sat_solver.get_variable(literal.first).value != UNASSIGNED)
+                continue;
+            reason.push_back({literal.first, !literal.second});
+            explain(reason);
+            reason.pop_back();
+        }
+    }
+    return nullopt;
+}
+
+#define SAT_INSTANTIATE(Decision, Restart, Reduction, Phase)                                                                               \
+    template void BasicSATSolver<SolverPolicies<Decision, Restart, Reduction, Phase>>::CardinalityPropagator::add(                         \
+        const vector<pair<VariableID, bool>> &, size_t);                                                                                  \
+    template auto BasicSATSolver<SolverPolicies<Decision, Restart, Reduction, Phase>>::CardinalityPropagator::propagate()->optional<ClauseID>;
+SAT_REGISTERED_POLICIES(SAT_INSTANTIATE)
@@ -0,0 +1,361 @@
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <unistd.h>
+#include "daemon.hpp"
+#include "dimacs.hpp"
+#include "sat_solver.hpp"
+
+namespace
+{
+    volatile sig_atomic_t stop_signal = 0;
+
+    void on_stop_signal(int)
+    {
+        stop_signal = 1;
+    }
+
+    // Payloads larger than this are rejected.
+    constexpr size_t max_payload = size_t(1) << 30;
+
+    bool send_all(int fd, const string &data)
+    {
+        size_t sent = 0;
+        while (sent < data.size())
+        {
+            auto n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    bool recv_line(int fd, string &line)
+    {
+        char c;
+        line.clear();
+        while (line.size() < 4096)
+        {
+            if (recv(fd, &c, 1, 0) != 1)
+                return false;
+            if (c == '\n')
+                return true;
+            line.push_back(c);
+        }
+        return false;
+    }
+
+    bool recv_exact(int fd, string &data, size_t size)
+    {
+        data.resize(size);
+        size_t received = 0;
+        while (received < size)
+        {
+            auto n = recv(fd, &data[received], size - received, 0);
+            if (n <= 0)
+                return false;
+            received += n;
+        }
+        return true;
+    }
+
+    void reply_and_close(int fd, const string &message)
+    {
+        send_all(fd, message);
+        close(fd);
+    }
+}
+
+int SolverDaemon::run()
+{
+    if (config.socket_path.size() >= sizeof(sockaddr_un::sun_path))
+    {
+        cerr << "Socket path too long" << endl;
+        return -1;
+    }
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+    {
+        cerr << "socket: " << strerror(errno) << endl;
+        return -1;
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, config.socket_path.c_str());
+    unlink(config.socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(listen_fd, 128) < 0)
+    {
+        cerr << "bind/listen: " << strerror(errno) << endl;
+        close(listen_fd);
+        return -1;
+    }
+
+    struct sigaction action
+    {
+    };
+    action.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!config.cache_path.empty())
+        cache = make_unique<ResultCache>(config.cache_path);
+
+    for (size_t i = 0; i < max<size_t>(config.worker_num, 1); i++)
+        workers.emplace_back(&SolverDaemon::worker_loop, this);
+    cerr << "[Daemon] listening on " << config.socket_path << " with " << workers.size() << " workers" << endl;
+
+    while (!stop_signal)
+    {
+        pollfd listen_poll{listen_fd, POLLIN, 0};
+        if (poll(&listen_poll, 1, 200) <= 0)
+            continue;
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd >= 0)
+            accept_connection(fd);
+    }
+
+    stopping = true;
+    jobs_cv.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+    // The requests being read are queued, then answered below. The receive timeout bounds the wait.
+    unique_lock<mutex> lock(jobs_mutex);
+    jobs_cv.wait(lock, [this]()
+                 { return reading_num == 0; });
+    while (!jobs.empty())
+    {
+        reply_and_close(jobs.top().fd, "ERROR shutting down\n");
+        jobs.pop();
+    }
+    close(listen_fd);
+    unlink(config.socket_path.c_str());
+    return 0;
+}
+
+/**
+ * @brief Take a place in the queue for the connection, or answer `BUSY` without reading anything.
+ *
+ */
+void SolverDaemon::accept_connection(int fd)
+{
+    {
+        lock_guard<mutex> lock(jobs_mutex);
+        // Shed load instead of letting the latency of every queued request grow.
+        if (jobs.size() + reading_num >= config.queue_capacity)
+            return reply_and_close(fd, "BUSY\n");
+        reading_num++;
+    }
+    thread(&SolverDaemon::receive, this, fd).detach();
+}
+
+/**
+ * @brief Read the request and queue it, off the acceptor thread and the workers, so that a slow or malformed request occupies neither.
+ *
+ */
+void SolverDaemon::receive(int fd)
+{
+    Job job{fd, 0, 0, chrono::milliseconds::zero(), 0, true, false, "", {}};
+    bool received = read_request(fd, job);
+    lock_guard<mutex> lock(jobs_mutex);
+    reading_num--;
+    if (received)
+    {
+        job.sequence = next_sequence++;
+        job.enqueued = chrono::steady_clock::now();
+        jobs.push(std::move(job));
+    }
+    // Under the lock: once `run` sees no request being read, it may return and destroy the daemon.
+    jobs_cv.notify_all();
+}
+
+/**
+ * @brief Read the header and the payload of a request into `job`.
+ *
+ * @return false if the request is malformed; it has been answered and the connection closed.
+ */
+bool SolverDaemon::read_request(int fd, Job &job)
+{
+    timeval recv_timeout{5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+    auto reject = [fd](const string &message)
+    {
+        reply_and_close(fd, message);
+        return false;
+    };
+
+    string line;
+    if (!recv_line(fd, line))
+        return reject("ERROR malformed request\n");
+
+    istringstream header(line);
+    string word;
+    header >> word;
+    if (word != "SOLVE")
+        return reject("ERROR unknown command\n");
+    optional<size_t> cnf_size;
+    try
+    {
+        while (header >> word)
+        {
+            auto eq = word.find('=');
+            auto key = word.substr(0, eq);
+            auto value = eq == string::npos ? "" : word.substr(eq + 1);
+            if (key == "priority")
+                job.priority = stoll(value);
+            else if (key == "timeout")
+                job.timeout = chrono::milliseconds(stoull(value));
+            else if (key == "conflicts")
+                job.conflict_limit = stoull(value);
+            else if (key == "model")
+                job.want_model = value != "0";
+            else if (key == "file")
+                job.payload = value;
+            else if (key == "cnf")
+                cnf_size = stoull(value);
+            else
+                return reject("ERROR unknown option " + key + "\n");
+        }
+    }
+    catch (const exception &)
+    {
+        return reject("ERROR malformed option " + word + "\n");
+    }
+
+    if (cnf_size.has_value())
+    {
+        if (cnf_size.value() > max_payload)
+            return reject("ERROR payload too large\n");
+        job.inline_cnf = true;
+        if (!recv_exact(fd, job.payload, cnf_size.value()))
+            return reject("ERROR truncated payload\n");
+    }
+    else if (job.payload.empty())
+        return reject("ERROR missing file= or cnf=\n");
+    return true;
+}
+
+void SolverDaemon::worker_loop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            unique_lock<mutex> lock(jobs_mutex);
+            jobs_cv.wait(lock, [this]()
+                         { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            job = jobs.top();
+            jobs.pop();
+        }
+        serve(job);
+        close(job.fd);
+    }
+}
+
+void SolverDaemon::serve(Job &job)
+{
+    auto start = chrono::steady_clock::now();
+
+    pair<CNF, int> cnf;
+    vector<CardinalityConstraint> cardinality_constraints;
+    try
+    {
+        if (job.inline_cnf)
+        {
+            istringstream input(job.payload);
+            cnf = DIMACS2vec(input, &cardinality_constraints);
+        }
+        else
+        {
+            ifstream input(job.payload);
+            if (!input)
+            {
+                send_all(job.fd, "ERROR failed to open " + job.payload + "\n");
+                return;
+            }
+            cnf = DIMACS2vec(input, &cardinality_constraints);
+        }
+    }
+    catch (const exception &)
+    {
+        send_all(job.fd, "ERROR malformed cnf\n");
+        return;
+    }
+
+    optional<ResultCache::Fingerprint> fingerprint;
+    // The fingerprint does not cover cardinality constraints.
+    bool use_cache = cache && cardinality_constraints.empty();
+    if (use_cache)
+    {
+        fingerprint = ResultCache::fingerprint(cnf.first);
+        auto cached = cache->lookup(cnf.first, fingerprint.value());
+        if (cached.has_value())
+        {
+            auto end = chrono::steady_clock::now();
+            respond(job, cached->first, cached->second, start - job.enqueued, end - start, SATSolver::Statistic{}, true);
+            return;
+        }
+    }
+
+    ostream null_log(nullptr);
+    SATSolver sat_solver(null_log);
+    sat_solver.initiate(cnf.first.begin(), cnf.first.end());
+    add_cardinality_constraints(sat_solver, cardinality_constraints);
+
+    auto deadline = start + job.timeout;
+    bool has_deadline = job.timeout != chrono::milliseconds::zero();
+    sat_solver.set_terminate([&]()
+                             { return stopping ||
+                                      (has_deadline && chrono::steady_clock::now() > deadline) ||
+                                      (job.conflict_limit != 0 && sat_solver.get_statistics().backjumpNum >= job.conflict_limit); });
+    auto result = sat_solver.solve(vector<pair<bool, size_t>>{});
+    auto end = chrono::steady_clock::now();
+
+    unordered_map<size_t, bool> assignment;
+    if (result.value_or(false))
+    {
+        assignment = sat_solver.get_result();
+        if (!check_assignment(cnf.first, assignment) || !check_assignment(cardinality_constraints, assignment))
+        {
+            send_all(job.fd, "ERROR assertion on result fails\n");
+            return;
+        }
+    }
+    if (use_cache && result.has_value())
+        cache->store(fingerprint.value(), result.value(), assignment);
+    respond(job, result, assignment, start - job.enqueued, end - start, sat_solver.get_statistics(), false);
+}
+
+void SolverDaemon::respond(Job &job, optional<bool> result, const unordered_map<size_t, bool> &assignment,
+                           chrono::nanoseconds queue_time, chrono::nanoseconds solve_time,
+                           const SATSolver::Statistic &statistic, bool cached)
+{
+    ostringstream response;
+    response << "RESULT " << (result.has_value() ? (result.value() ? "SAT" : "UNSAT") : "UNKNOWN") << "\n";
+    if (result.value_or(false) && job.want_model)
+    {
+        vector<pair<size_t, bool>> model(assignment.begin(), assignment.end());
+        sort(model.begin(), model.end());
+        response << "MODEL";
+        for (auto &assign : model)
+            response << " " << (assign.second ? "" : "-") << assign.first;
+        response << " 0\n";
+    }
+    response << "STATS queue_ns=" << queue_time.count()
+             << " solve_ns=" << solve_time.count()
+             << " decisions=" << statistic.decisionNum
+             << " backjumps=" << statistic.backjumpNum;
+    if (cached)
+        response << " cached=1";
+    response << "\n";
+    send_all(job.fd, response.str());
+}
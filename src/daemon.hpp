@@ -0,0 +1,103 @@
+#include <string>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "result_cache.hpp"
+#include "sat_solver.hpp"
+
+#ifndef SAT_DAEMON
+#define SAT_DAEMON
+
+using namespace std;
+
+/**
+ * @brief Serve solving requests over a Unix domain socket with a pool of worker threads.
+ *
+ * Protocol: one request per connection. The client sends a header line
+ *
+ *     SOLVE [priority=<int>] [timeout=<ms>] [conflicts=<n>] [model=0|1] (file=<path> | cnf=<bytes>)
+ *
+ * followed, for `cnf=`, by exactly <bytes> bytes of DIMACS text. The daemon answers with
+ *
+ *     RESULT SAT|UNSAT|UNKNOWN
+ *     MODEL <lit> <lit> ... 0          (SAT only, unless model=0)
+ *     STATS queue_ns=.. solve_ns=.. decisions=.. backjumps=.. [cached=1]
+ *
+ * or a single line `BUSY` if the queue is full, or `ERROR <message>`.
+ * A connection takes a place in the queue as soon as it is accepted, so that `BUSY` is answered before the request is read.
+ * The request is then read on a thread of its own, so that a slow client delays neither the other connections nor the workers.
+ * Requests with a larger priority are served first; equal priorities are served in arrival order.
+ *
+ */
+class SolverDaemon
+{
+public:
+    struct Config
+    {
+        string socket_path;
+        size_t worker_num = 4;
+        size_t queue_capacity = 64;
+        // No cache if empty
+        string cache_path;
+    };
+
+private:
+    struct Job
+    {
+        int fd;
+        long long priority;
+        size_t sequence;
+        chrono::milliseconds timeout;
+        size_t conflict_limit;
+        bool want_model;
+        bool inline_cnf;
+        string payload; // DIMACS text or file path
+        chrono::steady_clock::time_point enqueued;
+
+        bool operator<(const Job &other) const
+        {
+            if (priority != other.priority)
+                return priority < other.priority;
+            return sequence > other.sequence;
+        }
+    };
+
+    Config config;
+    int listen_fd = -1;
+
+    priority_queue<Job> jobs;
+    // Requests being read, which already count against the capacity of the queue
+    size_t reading_num = 0;
+    size_t next_sequence = 0;
+    mutex jobs_mutex;
+    condition_variable jobs_cv;
+    atomic<bool> stopping{false};
+    vector<thread> workers;
+    unique_ptr<ResultCache> cache;
+
+    void accept_connection(int fd);
+    void receive(int fd);
+    bool read_request(int fd, Job &job);
+    void worker_loop();
+    void serve(Job &job);
+    void respond(Job &job, optional<bool> result, const unordered_map<size_t, bool> &assignment,
+                 chrono::nanoseconds queue_time, chrono::nanoseconds solve_time,
+                 const SATSolver::Statistic &statistic, bool cached);
+
+public:
+    SolverDaemon(Config config) : config(std::move(config)) {}
+
+    /**
+     * @brief Serve until SIGINT or SIGTERM.
+     *
+     * @return int exit code
+     */
+    int run();
+};
+
+#endif
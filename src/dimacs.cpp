@@ -0,0 +1,213 @@
+#include <string>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <string_view>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include "dimacs.hpp"
+#include "utility.hpp"
+
+namespace
+{
+    struct ParsedChunk
+    {
+        CNF clauses;
+        vector<CardinalityConstraint> cardinality_constraints;
+        int var_num = 0;
+        // A token starting with '%' ends the formula.
+        bool terminated = false;
+    };
+
+    bool is_space(char c)
+    {
+        return isspace(static_cast<unsigned char>(c));
+    }
+
+    /**
+     * @brief Parse [begin, end), which starts and ends at clause boundaries. Tokens are separated by whitespace, as read by `istream >> string`.
+     *
+     */
+    void parse_chunk(const char *begin, const char *end, bool with_cardinality, ParsedChunk &chunk)
+    {
+        vector<pair<bool, size_t>> cur_clause;
+        const char *pos = begin;
+        auto next_token = [&]() -> optional<string_view>
+        {
+            while (pos != end && is_space(*pos))
+                pos++;
+            if (pos == end)
+                return nullopt;
+            const char *token = pos;
+            while (pos != end && !is_space(*pos))
+                pos++;
+            return string_view(token, pos - token);
+        };
+        auto to_int = [](string_view token)
+        {
+            // Like `stoi`: an optional sign and at least one digit, trailing characters ignored
+            size_t i = token[0] == '-' || token[0] == '+';
+            if (i == token.size() || !isdigit(static_cast<unsigned char>(token[i])))
+                throw invalid_argument("bad literal: " + string(token));
+            long long value = 0;
+            for (; i < token.size() && isdigit(static_cast<unsigned char>(token[i])); i++)
+            {
+                value = value * 10 + (token[i] - '0');
+                if (value > numeric_limits<int>::max())
+                    throw out_of_range("literal out of range: " + string(token));
+            }
+            return static_cast<int>(token[0] == '-' ? -value : value);
+        };
+
+        while (auto token = next_token())
+        {
+            if (isalpha(static_cast<unsigned char>(token->front())))
+                pos = find(pos, end, '\n');
+            else if (token->front() == '%')
+            {
+                chunk.terminated = true;
+                return;
+            }
+            else if (token == "<=" || token == ">=")
+            {
+                if (!with_cardinality)
+                    throw invalid_argument("cardinality constraints are not supported");
+                auto bound = next_token();
+                if (!bound.has_value())
+                    throw invalid_argument("missing bound of a cardinality constraint");
+                // Unsigned: a sign would make `to_int` accept a negative bound.
+                if (!isdigit(static_cast<unsigned char>(bound->front())))
+                    throw invalid_argument("bad bound of a cardinality constraint: " + string(bound.value()));
+                chunk.cardinality_constraints.push_back({std::move(cur_clause), token == "<=", static_cast<size_t>(to_int(bound.value()))});
+                cur_clause.clear();
+            }
+            else
+            {
+                int value = to_int(token.value());
+                if (value == 0)
+                {
+                    chunk.clauses.push_back(std::move(cur_clause));
+                    cur_clause.clear();
+                }
+                else
+                {
+                    chunk.var_num = std::max(chunk.var_num, abs(value));
+                    if (value < 0)
+                        cur_clause.push_back({false, -value});
+                    else
+                        cur_clause.push_back({true, value});
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief The first line end at or after `pos` which ends a clause: the last token of its line is "0", and the line is not a comment.
+     *
+     * @return the position after that line end, or the end of the buffer
+     */
+    size_t next_clause_boundary(const string &buffer, size_t pos)
+    {
+        size_t line_begin = pos == 0 ? string::npos : buffer.rfind('\n', pos - 1);
+        line_begin = line_begin == string::npos ? 0 : line_begin + 1;
+        while (line_begin < buffer.size())
+        {
+            size_t line_end = buffer.find('\n', line_begin);
+            if (line_end == string::npos)
+                return buffer.size();
+            size_t first = line_begin, last = line_end;
+            while (first < line_end && is_space(buffer[first]))
+                first++;
+            while (last > first && is_space(buffer[last - 1]))
+                last--;
+            bool comment = first == line_end || isalpha(static_cast<unsigned char>(buffer[first])) || buffer[first] == '%';
+            if (!comment && buffer[last - 1] == '0' && (last - 1 == first || is_space(buffer[last - 2])))
+                return line_end + 1;
+            line_begin = line_end + 1;
+        }
+        return buffer.size();
+    }
+}
+
+pair<CNF, int> DIMACS2vec(istream &input, vector<CardinalityConstraint> *cardinality_constraints)
+{
+    string buffer(istreambuf_iterator<char>(input), {});
+    return parse_dimacs(buffer, 1, cardinality_constraints);
+}
+
+pair<CNF, int> parse_dimacs(const string &buffer, size_t thread_num, vector<CardinalityConstraint> *cardinality_constraints)
+{
+    // Chunks of at least 1 MiB
+    size_t chunk_num = parallel_range_num(thread_num, buffer.size(), 1 << 20);
+    vector<size_t> bounds{0};
+    for (size_t chunk = 1; chunk < chunk_num; chunk++)
+        bounds.push_back(std::max(bounds.back(), next_clause_boundary(buffer, buffer.size() * chunk / chunk_num)));
+    bounds.push_back(buffer.size());
+
+    vector<ParsedChunk> chunks(chunk_num);
+    parallel_for(chunk_num, chunk_num, [&](size_t chunk, size_t, size_t)
+                 { parse_chunk(buffer.data() + bounds[chunk], buffer.data() + bounds[chunk + 1], cardinality_constraints != nullptr, chunks[chunk]); });
+
+    CNF res;
+    int var_num = 0;
+    size_t used_num = 0, clause_num = 0;
+    while (used_num < chunk_num && (used_num == 0 || !chunks[used_num - 1].terminated))
+        clause_num += chunks[used_num++].clauses.size();
+    res.reserve(clause_num);
+    for (size_t chunk = 0; chunk < used_num; chunk++)
+    {
+        move(chunks[chunk].clauses.begin(), chunks[chunk].clauses.end(), back_inserter(res));
+        if (cardinality_constraints != nullptr)
+            move(chunks[chunk].cardinality_constraints.begin(), chunks[chunk].cardinality_constraints.end(), back_inserter(*cardinality_constraints));
+        var_num = std::max(var_num, chunks[chunk].var_num);
+    }
+    return {res, var_num};
+}
+
+bool check_assignment(const CNF &cnf, unordered_map<size_t, bool> &assignment)
+{
+    bool formula_value = true;
+    for (auto &clause : cnf)
+    {
+        bool cur_clause_assign = false;
+        for (auto &literal : clause)
+        {
+            cur_clause_assign |= !(literal.first ^ assignment[literal.second]);
+        }
+        formula_value &= cur_clause_assign;
+    }
+    return formula_value;
+}
+
+bool check_assignment(const vector<CardinalityConstraint> &cardinality_constraints, unordered_map<size_t, bool> &assignment)
+{
+    for (auto &constraint : cardinality_constraints)
+    {
+        size_t true_num = 0;
+        for (auto &literal : constraint.literals)
+            true_num += literal.first == assignment[literal.second];
+        if (constraint.at_most ? true_num > constraint.bound : true_num < constraint.bound)
+            return false;
+    }
+    return true;
+}
+
+uint64_t formula_key(const CNF &cnf, const vector<CardinalityConstraint> &cardinality_constraints)
+{
+    uint64_t key = hash_combine(cnf.size(), cardinality_constraints.size());
+    auto add_literals = [&](const vector<pair<bool, size_t>> &literals)
+    {
+        key = hash_combine(key, literals.size());
+        for (auto &literal : literals)
+            key = hash_combine(key, 2 * literal.second + literal.first);
+    };
+    for (auto &clause : cnf)
+        add_literals(clause);
+    for (auto &constraint : cardinality_constraints)
+    {
+        add_literals(constraint.literals);
+        key = hash_combine(hash_combine(key, constraint.at_most), constraint.bound);
+    }
+    return key;
+}
@@ -0,0 +1,77 @@
+#include <vector>
+#include <unordered_map>
+#include <istream>
+#include <string>
+#include <utility>
+#include <cstdint>
+
+#ifndef DIMACS
+#define DIMACS
+
+using namespace std;
+
+using CNF = vector<vector<pair<bool, size_t>>>;
+
+/**
+ * @brief At most / at least `bound` of `literals` are true
+ *
+ */
+struct CardinalityConstraint
+{
+    vector<pair<bool, size_t>> literals;
+    bool at_most;
+    size_t bound;
+};
+
+/**
+ * @brief Parse a formula in .cnf format
+ *
+ * Lines of the form `l1 l2 ... <= k` and `l1 l2 ... >= k` (as in the CNF+ format, without the terminating 0) are cardinality constraints.
+ * They are stored into `cardinality_constraints`; if it is null, they are rejected with `invalid_argument`.
+ *
+ * @param input
+ * @return pair<CNF, int> the clauses and the largest variable name
+ */
+pair<CNF, int> DIMACS2vec(istream &input, vector<CardinalityConstraint> *cardinality_constraints = nullptr);
+
+/**
+ * @brief Parse a formula in .cnf format from a buffer, on up to `thread_num` threads, with the same result as `DIMACS2vec`.
+ *
+ * The buffer is split at line ends which end a clause, and each chunk is parsed into its own clauses, which are then concatenated in order.
+ *
+ */
+pair<CNF, int> parse_dimacs(const string &buffer, size_t thread_num, vector<CardinalityConstraint> *cardinality_constraints = nullptr);
+
+/**
+ * @brief Check the assignment really satisfies the formula
+ *
+ */
+bool check_assignment(const CNF &cnf, unordered_map<size_t, bool> &assignment);
+
+bool check_assignment(const vector<CardinalityConstraint> &cardinality_constraints, unordered_map<size_t, bool> &assignment);
+
+/**
+ * @brief A hash of the formula as written: unlike the fingerprint of the result cache, it depends on the order of the clauses and literals.
+ *
+ */
+uint64_t formula_key(const CNF &cnf, const vector<CardinalityConstraint> &cardinality_constraints);
+
+/**
+ * @brief Give the cardinality constraints to a solver (after `initiate`).
+ *
+ * NOTE Since it's a template, I put the definition in the header.
+ *
+ */
+template <typename Solver>
+void add_cardinality_constraints(Solver &sat_solver, const vector<CardinalityConstraint> &cardinality_constraints)
+{
+    for (auto &constraint : cardinality_constraints)
+    {
+        if (constraint.at_most)
+            sat_solver.add_at_most(constraint.literals, constraint.bound);
+        else
+            sat_solver.add_at_least(constraint.literals, constraint.bound);
+    }
+}
+
+#endif
@@ -0,0 +1,364 @@
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <optional>
+#include <algorithm>
+#include "sat_solver.hpp"
+
+#ifndef ENUMERATION
+#define ENUMERATION
+
+using namespace std;
+
+/**
+ * @brief Enumerate the models of the formula in a solver, projected on a set of variables.
+ *
+ * Each model is shrunk to a cube: the projected literals which cannot be dropped without falsifying a clause or possibly exceeding the bound of
+ * a cardinality constraint (with the other variables fixed).
+ * Every projected assignment extending the cube is then a model, and the negation of the cube is added as a blocking clause.
+ * The clauses checked include the previous blocking clauses, so the cubes are disjoint. Learnt clauses are kept from one model to the next.
+ *
+ * @tparam Solver a `BasicSATSolver`
+ */
+template <typename Solver>
+class ModelEnumerator
+{
+    using VariableID = typename Solver::VariableID;
+    using ClauseID = typename Solver::ClauseID;
+
+    Solver &sat_solver;
+    vector<size_t> projection;
+    BigCount model_num;
+    size_t cube_num = 0;
+
+public:
+    /**
+     * @param projection original names of the projected variables. They need not appear in the formula.
+     */
+    ModelEnumerator(Solver &sat_solver, vector<size_t> projection) : sat_solver(sat_solver), projection(std::move(projection)) {}
+
+    /**
+     * @brief Find the next cube of projected models.
+     *
+     * @return the literals of the cube, in the form of the input of `initiate`; the other projected variables are free.
+     * nullopt if there are no more models, or the search is interrupted by the terminate callback.
+     */
+    optional<vector<pair<bool, size_t>>> next()
+    {
+        auto result = sat_solver.solve({});
+        if (!result.has_value() || !result.value())
+            return nullopt;
+
+        auto cube = shrink();
+        cube_num++;
+        BigCount cube_models(1);
+        cube_models <<= projection.size() - cube.size();
+        model_num += cube_models;
+
+        vector<vector<pair<bool, size_t>>> blocking_clause(1);
+        for (auto &literal : cube)
+            blocking_clause[0].push_back({!literal.first, literal.second});
+        // An empty cube gives an empty blocking clause: there is nothing left to enumerate.
+        sat_solver.initiate(blocking_clause.begin(), blocking_clause.end());
+        return cube;
+    }
+
+    const BigCount &get_model_num() const
+    {
+        return model_num;
+    }
+
+    size_t get_cube_num() const
+    {
+        return cube_num;
+    }
+
+private:
+    /**
+     * @brief Greedily drop the projected literals of the current (full) assignment while every clause keeps a true literal.
+     *
+     */
+    vector<pair<bool, size_t>> shrink()
+    {
+        // Clause -> number of its true literals not dropped yet. Removed learnt clauses have no literals and are skipped.
+        unordered_map<ClauseID, size_t> true_num;
+        for (auto &clause : sat_solver.clauses)
+            if (!clause.get_literals().empty())
+                true_num[clause.get_clause_id()] = clause.get_literals_by_value(TRUE).size();
+
+        // Cardinality constraint -> number of its literals which are true or dropped
+        auto &constraints = sat_solver.cardinality_propagator.get_constraints();
+        vector<size_t> load;
+        for (auto &constraint : constraints)
+            load.push_back(constraint.true_num);
+
+        vector<pair<bool, size_t>> cube;
+        for (auto name : projection)
+        {
+            auto res = sat_solver.OriginalName2varID.find(name);
+            if (res == sat_solver.OriginalName2varID.end())
+                continue;
+            auto &variable = sat_solver.get_variable(res->second);
+            bool value = variable.value == TRUE;
+            auto is_true_in = [&](ClauseID clauseID)
+            {
+                return sat_solver.get_clause(clauseID).get_literals().at(variable.variableID).get_literal_type() == value;
+            };
+            bool essential = false;
+            for (auto clauseID : variable.clauses)
+                if (is_true_in(clauseID) && true_num[clauseID] == 1)
+                {
+                    essential = true;
+                    break;
+                }
+            // A dropped literal which is false may become true.
+            auto &occurrences = sat_solver.cardinality_propagator.get_occurrences(variable.variableID);
+            unordered_map<size_t, size_t> false_occurrence_num;
+            for (auto &constraint_type : occurrences)
+                if (constraint_type.second != value)
+                    false_occurrence_num[constraint_type.first]++;
+            for (auto &constraint_num : false_occurrence_num)
+                essential = essential || load[constraint_num.first] + constraint_num.second > constraints[constraint_num.first].bound;
+            if (essential)
+                cube.push_back({value, name});
+            else
+            {
+                for (auto clauseID : variable.clauses)
+                    if (is_true_in(clauseID))
+                        true_num[clauseID]--;
+                for (auto &constraint_num : false_occurrence_num)
+                    load[constraint_num.first] += constraint_num.second;
+            }
+        }
+        return cube;
+    }
+};
+
+/**
+ * @brief Count the models of the formula in a solver, projected on a set of variables, by DPLL with component caching (#SAT).
+ *
+ * The search runs on the data structures of the solver: decisions and propagation go through its trail, and are undone by backtracking.
+ * The unsatisfied clauses and the cardinality constraints which may still be violated split the unassigned variables into connected components,
+ * which are counted separately and multiplied.
+ * Only projected variables are branched on while a component has any; a component without projected variables counts 1 if it is satisfiable.
+ * A component is identified by its variables, its unsatisfied clauses and its open constraints with their numbers of true literals,
+ * which determine the residual formula; counts are cached by this key.
+ *
+ * @tparam Solver a `BasicSATSolver`
+ */
+template <typename Solver>
+class ModelCounter
+{
+    using VariableID = typename Solver::VariableID;
+    using ClauseID = typename Solver::ClauseID;
+
+    // Flush the cache beyond this number of entries
+    static constexpr size_t cache_capacity = 1 << 20;
+
+    Solver &sat_solver;
+    vector<size_t> projection;
+    vector<bool> projected;
+    map<vector<size_t>, BigCount> cache;
+
+public:
+    struct Statistic
+    {
+        size_t decisionNum = 0;
+        size_t componentNum = 0;
+        size_t cacheHitNum = 0;
+    };
+
+private:
+    Statistic statistic;
+
+public:
+    /**
+     * @param projection original names of the projected variables. They need not appear in the formula.
+     */
+    ModelCounter(Solver &sat_solver, vector<size_t> projection) : sat_solver(sat_solver), projection(std::move(projection)) {}
+
+    BigCount count()
+    {
+        if (sat_solver.inconsistent)
+            return 0;
+        sat_solver.backtrack(0);
+        if (sat_solver.propagate().has_value())
+        {
+            sat_solver.inconsistent = true;
+            return 0;
+        }
+
+        projected.assign(sat_solver.variables.size(), false);
+        size_t unknown_num = 0;
+        vector<VariableID> unassigned;
+        for (auto name : projection)
+        {
+            auto res = sat_solver.OriginalName2varID.find(name);
+            if (res == sat_solver.OriginalName2varID.end())
+                unknown_num++;
+            else
+                projected[res->second] = true;
+        }
+        for (auto &variable : sat_solver.variables)
+            if (variable.value == UNASSIGNED)
+                unassigned.push_back(variable.variableID);
+
+        // The projected variables which do not appear in the formula are free.
+        BigCount result = count_unassigned(unassigned);
+        result <<= unknown_num;
+        return result;
+    }
+
+    Statistic get_statistics() const
+    {
+        return statistic;
+    }
+
+private:
+    bool is_open(ClauseID clauseID)
+    {
+        auto &clause = sat_solver.get_clause(clauseID);
+        return !clause.get_literals().empty() && clause.value() != TRUE;
+    }
+
+    /**
+     * @brief The unassigned variables of a cardinality constraint, if assigning them may still exceed its bound.
+     *
+     */
+    vector<VariableID> open_variables(size_t constraint_id)
+    {
+        auto &constraint = sat_solver.cardinality_propagator.get_constraints()[constraint_id];
+        vector<VariableID> variables;
+        for (auto &literal : constraint.literals)
+            if (sat_solver.get_variable(literal.first).value == UNASSIGNED)
+                variables.push_back(literal.first);
+        if (constraint.true_num + variables.size() <= constraint.bound)
+            variables.clear();
+        return variables;
+    }
+
+    /**
+     * @brief The count of the residual formula over `variables`, which are closed under the unsatisfied clauses. Assigned ones are skipped.
+     *
+     */
+    BigCount count_unassigned(const vector<VariableID> &variables)
+    {
+        BigCount result(1);
+        unordered_set<VariableID> visited;
+        for (auto root : variables)
+        {
+            if (sat_solver.get_variable(root).value != UNASSIGNED || !visited.insert(root).second)
+                continue;
+            // Breadth-first search over the unsatisfied clauses
+            vector<VariableID> component{root};
+            unordered_set<ClauseID> component_clauses;
+            // Visited cardinality constraints -> whether they are open
+            map<size_t, bool> component_constraints;
+            for (size_t i = 0; i < component.size(); i++)
+            {
+                for (auto clauseID : sat_solver.get_variable(component[i]).clauses)
+                    if (is_open(clauseID) && component_clauses.insert(clauseID).second)
+                        for (auto var_id : sat_solver.get_clause(clauseID).get_literals_by_value(UNASSIGNED))
+                            if (visited.insert(var_id).second)
+                                component.push_back(var_id);
+                for (auto &constraint_type : sat_solver.cardinality_propagator.get_occurrences(component[i]))
+                {
+                    if (component_constraints.count(constraint_type.first))
+                        continue;
+                    auto variables = open_variables(constraint_type.first);
+                    component_constraints[constraint_type.first] = !variables.empty();
+                    for (auto var_id : variables)
+                        if (visited.insert(var_id).second)
+                            component.push_back(var_id);
+                }
+            }
+            vector<pair<size_t, size_t>> open_constraints;
+            for (auto &constraint_open : component_constraints)
+                if (constraint_open.second)
+                    open_constraints.push_back({constraint_open.first, sat_solver.cardinality_propagator.get_constraints()[constraint_open.first].true_num});
+
+            if (component_clauses.empty() && open_constraints.empty())
+            {
+                if (projected[root])
+                    result <<= 1;
+                continue;
+            }
+            result *= count_component(component, component_clauses, open_constraints);
+            if (result.is_zero())
+                break;
+        }
+        return result;
+    }
+
+    /**
+     * @param open_constraints (constraint, number of true literals), sorted
+     */
+    BigCount count_component(vector<VariableID> &component, const unordered_set<ClauseID> &component_clauses,
+                             const vector<pair<size_t, size_t>> &open_constraints)
+    {
+        statistic.componentNum++;
+        sort(component.begin(), component.end());
+        vector<size_t> key(component);
+        // The separator cannot be a variable ID.
+        key.push_back(static_cast<size_t>(-1));
+        size_t variable_key_size = key.size();
+        key.insert(key.end(), component_clauses.begin(), component_clauses.end());
+        sort(key.begin() + variable_key_size, key.end());
+        key.push_back(static_cast<size_t>(-1));
+        for (auto &constraint_true_num : open_constraints)
+        {
+            key.push_back(constraint_true_num.first);
+            key.push_back(constraint_true_num.second);
+        }
+        auto cached = cache.find(key);
+        if (cached != cache.end())
+        {
+            statistic.cacheHitNum++;
+            return cached->second;
+        }
+
+        // Branch on the projected variable with the most unsatisfied clauses, or on any variable if none is projected.
+        bool existential = none_of(component.begin(), component.end(), [&](VariableID var_id)
+                                   { return projected[var_id]; });
+        optional<VariableID> branch;
+        size_t branch_occurrence = 0;
+        for (auto var_id : component)
+        {
+            if (!existential && !projected[var_id])
+                continue;
+            size_t occurrence = sat_solver.cardinality_propagator.get_occurrences(var_id).size();
+            for (auto clauseID : sat_solver.get_variable(var_id).clauses)
+                occurrence += component_clauses.count(clauseID);
+            if (!branch.has_value() || occurrence > branch_occurrence)
+            {
+                branch = var_id;
+                branch_occurrence = occurrence;
+            }
+        }
+
+        BigCount result;
+        for (bool value : {true, false})
+        {
+            statistic.decisionNum++;
+            auto decision_level = sat_solver.implication_graph.get_decision_level();
+            auto conflict = sat_solver.assign(branch.value(), value);
+            sat_solver.implication_graph.push_decision_node(branch.value());
+            if (!conflict.has_value())
+                conflict = sat_solver.propagate();
+            if (!conflict.has_value())
+                result += count_unassigned(component);
+            sat_solver.backtrack(decision_level);
+            // A component without projected variables only needs one model.
+            if (existential && !result.is_zero())
+                break;
+        }
+
+        if (cache.size() >= cache_capacity)
+            cache.clear();
+        cache.emplace(std::move(key), result);
+        return result;
+    }
+};
+
+#endif
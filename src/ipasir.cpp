@@ -0,0 +1,108 @@
+#include <cstdint>
+#include "ipasir.h"
+#include "sat_solver.hpp"
+
+namespace
+{
+    struct IpasirSolver
+    {
+        // The library never writes the search log.
+        ostream null_log{nullptr};
+        SATSolver sat_solver{null_log};
+
+        vector<pair<bool, size_t>> cur_clause;
+        vector<pair<bool, size_t>> assumptions;
+    };
+
+    IpasirSolver &cast(void *solver)
+    {
+        return *static_cast<IpasirSolver *>(solver);
+    }
+
+    pair<bool, size_t> int2literal(int32_t lit)
+    {
+        return {lit > 0, static_cast<size_t>(lit > 0 ? lit : -static_cast<int64_t>(lit))};
+    }
+}
+
+const char *ipasir_signature()
+{
+    return "my-SAT-Solver (CDCL)";
+}
+
+void *ipasir_init()
+{
+    return new IpasirSolver;
+}
+
+void ipasir_release(void *solver)
+{
+    delete &cast(solver);
+}
+
+void ipasir_add(void *solver, int32_t lit_or_zero)
+{
+    auto &ipasir_solver = cast(solver);
+    if (lit_or_zero != 0)
+    {
+        ipasir_solver.cur_clause.push_back(int2literal(lit_or_zero));
+        return;
+    }
+    array<vector<pair<bool, size_t>>, 1> clause{std::move(ipasir_solver.cur_clause)};
+    ipasir_solver.sat_solver.initiate(clause.begin(), clause.end());
+    ipasir_solver.cur_clause.clear();
+}
+
+void ipasir_assume(void *solver, int32_t lit)
+{
+    cast(solver).assumptions.push_back(int2literal(lit));
+}
+
+int ipasir_solve(void *solver)
+{
+    auto &ipasir_solver = cast(solver);
+    auto result = ipasir_solver.sat_solver.solve(ipasir_solver.assumptions);
+    ipasir_solver.assumptions.clear();
+    if (!result.has_value())
+        return 0;
+    return result.value() ? 10 : 20;
+}
+
+int32_t ipasir_val(void *solver, int32_t lit)
+{
+    auto literal = int2literal(lit);
+    auto value = cast(solver).sat_solver.get_value(literal.second);
+    if (!value.has_value())
+        return 0;
+    return value.value() == literal.first ? lit : -lit;
+}
+
+int ipasir_failed(void *solver, int32_t lit)
+{
+    return cast(solver).sat_solver.is_failed(int2literal(lit).second) ? 1 : 0;
+}
+
+void ipasir_set_terminate(void *solver, void *data, int (*terminate)(void *data))
+{
+    if (terminate == nullptr)
+        cast(solver).sat_solver.set_terminate(nullptr);
+    else
+        cast(solver).sat_solver.set_terminate([data, terminate]()
+                                               { return terminate(data) != 0; });
+}
+
+void ipasir_set_learn(void *solver, void *data, int max_length, void (*learn)(void *data, int32_t *clause))
+{
+    if (learn == nullptr)
+    {
+        cast(solver).sat_solver.set_learn(0, nullptr);
+        return;
+    }
+    cast(solver).sat_solver.set_learn(max_length < 0 ? 0 : max_length, [data, learn](const vector<pair<bool, size_t>> &clause)
+                                      {
+                                          vector<int32_t> lits;
+                                          for (auto &literal : clause)
+                                              lits.push_back(literal.first ? static_cast<int32_t>(literal.second) : -static_cast<int32_t>(literal.second));
+                                          lits.push_back(0);
+                                          learn(data, lits.data()); });
+}
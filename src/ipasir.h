@@ -0,0 +1,62 @@
+/**
+ * @brief The standard IPASIR incremental SAT solver interface.
+ *
+ * Literals are non-zero integers: `v` for the variable `v`, `-v` for its negation.
+ *
+ */
+
+#ifndef IPASIR_H
+#define IPASIR_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    const char *ipasir_signature();
+
+    void *ipasir_init();
+
+    void ipasir_release(void *solver);
+
+    /**
+     * @brief Add a literal to the clause under construction. 0 terminates the clause.
+     *
+     */
+    void ipasir_add(void *solver, int32_t lit_or_zero);
+
+    /**
+     * @brief Assume `lit` for the next call of `ipasir_solve` only.
+     *
+     */
+    void ipasir_assume(void *solver, int32_t lit);
+
+    /**
+     * @brief 10 for SAT, 20 for UNSAT, 0 if interrupted by the terminate callback.
+     *
+     */
+    int ipasir_solve(void *solver);
+
+    /**
+     * @brief After SAT: `lit` if it is true in the model, `-lit` if it is false, 0 if the variable is unknown.
+     *
+     */
+    int32_t ipasir_val(void *solver, int32_t lit);
+
+    /**
+     * @brief After UNSAT: 1 if the assumption `lit` was used to prove the unsatisfiability, 0 otherwise.
+     *
+     */
+    int ipasir_failed(void *solver, int32_t lit);
+
+    void ipasir_set_terminate(void *solver, void *data, int (*terminate)(void *data));
+
+    void ipasir_set_learn(void *solver, void *data, int max_length, void (*learn)(void *data, int32_t *clause));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,346 @@
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "sat_solver.hpp"
+
+#ifndef LOOKAHEAD
+#define LOOKAHEAD
+
+using namespace std;
+
+/**
+ * @brief DPLL with lookahead, on the data structures of a solver: probes and branches are decisions on its trail, undone by backtracking.
+ *
+ * At each node, a lookahead round probes both values of the preselected variables:
+ * - a value whose propagation conflicts is a failed literal, and the other value is necessary;
+ * - a variable implied to the same value by both probes is necessary;
+ * - a probe which creates many new binary clauses is followed by a double lookahead: the preselected variables are probed under it,
+ *   and if one of them fails both ways, the probe itself fails.
+ * Necessary assignments are learnt locally: they hold at the node and below, and are undone when the search leaves the node.
+ * Rounds are repeated until they find nothing new. The branching variable maximizes the product of the weighted new binaries of its 2 values.
+ *
+ * @tparam Solver a `BasicSATSolver`
+ */
+template <typename Solver>
+class LookaheadSolver
+{
+    using VariableID = typename Solver::VariableID;
+    using ClauseID = typename Solver::ClauseID;
+
+public:
+    struct Round
+    {
+        size_t depth;
+        size_t candidateNum = 0;
+        size_t failedNum = 0;
+        size_t necessaryNum = 0;
+        size_t doubleLookaheadNum = 0;
+        std::chrono::nanoseconds time{0};
+    };
+
+    struct Statistic
+    {
+        size_t nodeNum = 0;
+        vector<Round> rounds;
+    };
+
+private:
+    Solver &sat_solver;
+    Statistic statistic;
+    // A probe creating more weighted new binaries than this triggers a double lookahead
+    double double_lookahead_trigger = 0;
+    bool interrupted = false;
+
+public:
+    LookaheadSolver(Solver &sat_solver) : sat_solver(sat_solver) {}
+
+    /**
+     * @return true SAT, the model is left in the solver (see `get_result`)
+     * @return false UNSAT
+     * @return nullopt interrupted by the terminate callback of the solver
+     */
+    optional<bool> solve()
+    {
+        if (sat_solver.inconsistent)
+            return false;
+        sat_solver.backtrack(0);
+        if (sat_solver.propagate().has_value())
+        {
+            sat_solver.inconsistent = true;
+            return false;
+        }
+        interrupted = false;
+        bool result = search(0);
+        if (interrupted)
+            return nullopt;
+        return result;
+    }
+
+    const Statistic &get_statistics() const
+    {
+        return statistic;
+    }
+
+private:
+    size_t level()
+    {
+        return sat_solver.implication_graph.get_decision_level();
+    }
+
+    bool is_unassigned(VariableID variableID)
+    {
+        return sat_solver.get_variable(variableID).value == UNASSIGNED;
+    }
+
+    /**
+     * @brief Assign at a new decision level, and propagate.
+     *
+     * @return false if a conflict is found. The assignments are kept until backtracking anyway.
+     */
+    bool probe(VariableID variableID, bool value)
+    {
+        auto conflict = sat_solver.assign(variableID, value);
+        sat_solver.implication_graph.push_decision_node(variableID);
+        if (!conflict.has_value())
+            conflict = sat_solver.propagate();
+        return !conflict.has_value();
+    }
+
+    /**
+     * @brief Weight of a clause of `size` literals reduced to 2 unassigned literals
+     *
+     */
+    static double binary_weight(size_t size)
+    {
+        return pow(5.0, 3.0 - static_cast<double>(size));
+    }
+
+    /**
+     * @brief The weighted number of unsatisfied clauses reduced to binary clauses by the assignments from the trail position `from`.
+     *
+     */
+    double weighted_new_binaries(size_t from)
+    {
+        double weight = 0;
+        unordered_set<ClauseID> visited;
+        for (size_t pos = from; pos < sat_solver.implication_graph.size(); pos++)
+        {
+            auto &variable = sat_solver.get_variable(sat_solver.implication_graph[pos].variableID);
+            for (auto clauseID : variable.clauses)
+            {
+                auto &clause = sat_solver.get_clause(clauseID);
+                if (clause.to_decide_num() == 2 && clause.get_literals().size() > 2 && visited.insert(clauseID).second)
+                    weight += binary_weight(clause.get_literals().size());
+            }
+        }
+        return weight;
+    }
+
+    /**
+     * @brief Rank the unassigned variables by how much their values would reduce the unsatisfied clauses, and keep the best ones.
+     *
+     */
+    vector<VariableID> preselect()
+    {
+        // Literal (variable, type) -> weight of the clauses it occurs in, which get reduced when the literal is false
+        unordered_map<VariableID, array<double, 2>> occurrence;
+        for (auto var_id : sat_solver.variables_by_value[UNASSIGNED])
+        {
+            auto &weights = occurrence[var_id];
+            weights = {0, 0};
+            for (auto clauseID : sat_solver.get_variable(var_id).clauses)
+            {
+                auto &clause = sat_solver.get_clause(clauseID);
+                auto unassigned_num = clause.to_decide_num();
+                if (unassigned_num >= 2)
+                    weights[clause.get_literal(var_id).get_literal_type()] += binary_weight(unassigned_num);
+            }
+        }
+        vector<pair<double, VariableID>> ranked;
+        for (auto &var_weights : occurrence)
+        {
+            auto &w = var_weights.second;
+            ranked.push_back({w[0] * w[1] * 1024 + w[0] + w[1], var_weights.first});
+        }
+        size_t candidate_num = min(ranked.size(), max<size_t>(10, ranked.size() / 5));
+        partial_sort(ranked.begin(), ranked.begin() + candidate_num, ranked.end(), greater<pair<double, VariableID>>());
+        vector<VariableID> candidates;
+        for (size_t i = 0; i < candidate_num; i++)
+            candidates.push_back(ranked[i].second);
+        return candidates;
+    }
+
+    /**
+     * @brief Probe the candidates under the current probe. A candidate failing one way is assigned the other way.
+     *
+     * @return false if a candidate fails both ways, so that the current probe fails
+     */
+    bool double_lookahead(const vector<VariableID> &candidates, Round &round)
+    {
+        round.doubleLookaheadNum++;
+        for (auto var_id : candidates)
+        {
+            if (!is_unassigned(var_id))
+                continue;
+            for (bool value : {true, false})
+            {
+                auto probe_level = level();
+                bool ok = probe(var_id, value);
+                sat_solver.backtrack(probe_level);
+                if (!ok)
+                {
+                    if (!probe(var_id, !value))
+                        return false;
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Lookahead rounds at the current node, until no more necessary assignment is found.
+     *
+     * @param branch the variable to branch on, and the value to try first
+     * @return false if the node is UNSAT
+     */
+    bool lookahead(size_t depth, optional<pair<VariableID, bool>> &branch)
+    {
+        while (true)
+        {
+            auto start = std::chrono::steady_clock::now();
+            Round round{depth};
+            auto candidates = preselect();
+            round.candidateNum = candidates.size();
+            bool found_necessary = false;
+            bool conflict = false;
+            double best_score = -1;
+            branch.reset();
+
+            for (auto var_id : candidates)
+            {
+                if (!is_unassigned(var_id))
+                    continue;
+                array<double, 2> weights{0, 0};
+                array<bool, 2> failed{false, false};
+                array<unordered_map<VariableID, bool>, 2> implied;
+                for (bool value : {true, false})
+                {
+                    auto probe_level = level();
+                    auto from = sat_solver.implication_graph.size();
+                    bool ok = probe(var_id, value);
+                    if (ok)
+                    {
+                        weights[value] = weighted_new_binaries(from);
+                        if (weights[value] > double_lookahead_trigger)
+                        {
+                            ok = double_lookahead(candidates, round);
+                            // Raise the trigger past a useless double lookahead
+                            if (ok)
+                                double_lookahead_trigger = weights[value];
+                        }
+                    }
+                    if (ok)
+                        for (size_t pos = from + 1; pos < sat_solver.implication_graph.size(); pos++)
+                        {
+                            auto implied_id = sat_solver.implication_graph[pos].variableID;
+                            implied[value][implied_id] = sat_solver.get_variable(implied_id).value == TRUE;
+                        }
+                    sat_solver.backtrack(probe_level);
+                    failed[value] = !ok;
+                }
+
+                if (failed[true] && failed[false])
+                {
+                    conflict = true;
+                    break;
+                }
+                if (failed[true] || failed[false])
+                {
+                    round.failedNum++;
+                    round.necessaryNum++;
+                    found_necessary = true;
+                    if (!probe(var_id, failed[false]))
+                    {
+                        conflict = true;
+                        break;
+                    }
+                    continue;
+                }
+                // The assignments implied by both values
+                for (auto &var_value : implied[true])
+                {
+                    auto other = implied[false].find(var_value.first);
+                    if (other == implied[false].end() || other->second != var_value.second || !is_unassigned(var_value.first))
+                        continue;
+                    round.necessaryNum++;
+                    found_necessary = true;
+                    if (!probe(var_value.first, var_value.second))
+                    {
+                        conflict = true;
+                        break;
+                    }
+                }
+                if (conflict)
+                    break;
+
+                double score = weights[true] * weights[false] * 1024 + weights[true] + weights[false];
+                if (score > best_score)
+                {
+                    best_score = score;
+                    // The value creating fewer binaries leaves the easier subproblem, tried first.
+                    branch = make_pair(var_id, weights[true] <= weights[false]);
+                }
+            }
+
+            double_lookahead_trigger *= 0.95;
+            round.time = std::chrono::steady_clock::now() - start;
+            statistic.rounds.push_back(round);
+            if (conflict)
+                return false;
+            if (!found_necessary)
+                return true;
+        }
+    }
+
+    bool search(size_t depth)
+    {
+        if (sat_solver.terminate_callback && sat_solver.terminate_callback())
+        {
+            interrupted = true;
+            return false;
+        }
+        statistic.nodeNum++;
+        auto node_level = level();
+        optional<pair<VariableID, bool>> branch;
+        if (!lookahead(depth, branch))
+        {
+            sat_solver.backtrack(node_level);
+            return false;
+        }
+        if (sat_solver.variables_by_value[UNASSIGNED].empty())
+            return true;
+        // All the candidates were assigned by the last round.
+        if (!branch.has_value() || !is_unassigned(branch->first))
+            branch = make_pair(*sat_solver.variables_by_value[UNASSIGNED].begin(), true);
+
+        for (bool value : {branch->second, !branch->second})
+        {
+            auto branch_level = level();
+            if (probe(branch->first, value) && search(depth + 1))
+                return true;
+            sat_solver.backtrack(branch_level);
+            if (interrupted)
+                break;
+        }
+        sat_solver.backtrack(node_level);
+        return false;
+    }
+};
+
+#endif
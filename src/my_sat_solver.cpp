@@ -5,87 +5,466 @@
 #include <fstream>
 #include <chrono>
 #include <algorithm>
-#include <cctype>
+#include <csignal>
+#include <thread>
+#include <iterator>
+#include <map>
+#include <functional>
 #include "sat_solver.hpp"
+#include "policy_registry.hpp"
+#include "dimacs.hpp"
+#include "daemon.hpp"
+#include "result_cache.hpp"
+#include "symmetry.hpp"
+#include "enumeration.hpp"
+#include "lookahead.hpp"
+#include "backbone.hpp"
+#include "snapshot.hpp"
 
 using namespace std::chrono;
 using namespace std;
 
-pair<vector<vector<pair<bool, size_t>>>, int> DIMACS2vec(istream &input)
+const char *usage =
+    "Usage: sat_solver [options] [file]\n"
+    "       sat_solver --daemon [socket] [--workers N] [--queue-size N] [--cache path]\n"
+    "file should be in .cnf format, with optional cardinality constraints as lines `l1 l2 ... <= k` or `l1 l2 ... >= k`\n"
+    "Options:\n"
+    "  --cache path    look up and store results in the cache file at `path`\n"
+    "  --symmetry      add symmetry-breaking clauses before solving\n"
+    "  --xor           recover XOR constraints and propagate them by Gauss-Jordan elimination\n"
+    "  --decision name decision heuristic: vsids (default), chb, vmtf, first\n"
+    "  --restart name  restart schedule: luby (default), geometric, none\n"
+    "  --reduction name learnt clause reduction: lbd (default), none\n"
+    "  --phase name    phase selection: saving (default), true, false\n"
+    "                  only the combinations listed at the end are compiled in: each of these 4 options can be changed alone\n"
+    "  --lookahead     solve by DPLL with lookahead instead of CDCL, and report each lookahead round\n"
+    "  --checkpoint path  write a snapshot of the search state to `path` periodically, and on SIGTERM/SIGINT\n"
+    "  --checkpoint-interval S  seconds between snapshots (default: 60)\n"
+    "  --resume path   resume from the snapshot at `path`, if there is one for this formula\n"
+    "  --threads N     threads for parsing the input and building the solver's clauses (default: all the cores)\n"
+    "  --enumerate     print the models as cubes over the projected variables, one per line\n"
+    "  --count         print the number of models over the projected variables\n"
+    "  --backbone      print the literals true in every model over the projected variables, and the time spent on each\n"
+    "  --workers N     solvers testing the backbone candidates, each on its own thread (default: 1)\n"
+    "  --project list  comma-separated projected variables for --enumerate, --count and --backbone (default: all)\n"
+    "  --limit N       stop --enumerate after N cubes\n"
+    "--enumerate, --count and --backbone ignore --cache and --symmetry, which do not preserve the models.\n"
+    "--cache and --symmetry are also ignored if the formula has cardinality constraints.\n";
+
+void print_usage()
+{
+    cout << usage << "Compiled policy combinations (decision/restart/reduction/phase):\n"
+         << registered_policies();
+}
+
+// Set by SIGTERM/SIGINT when checkpointing, so that the search stops and saves its state
+volatile sig_atomic_t stop_requested = 0;
+
+void request_stop(int)
 {
-    vector<vector<pair<bool, size_t>>> res;
-    vector<pair<bool, size_t>> cur_clause;
-    int var_num = 0;
-    string tmp;
-    while (input >> tmp)
+    stop_requested = 1;
+}
+
+/**
+ * @brief Run `visitor` on a solver with the policies named by `names`.
+ *
+ */
+template <typename Visitor>
+int run_with_policies(const PolicyNames &names, Visitor &&visitor)
+{
+    auto exit_code = dispatch_policies(names, std::forward<Visitor>(visitor));
+    if (!exit_code.has_value())
     {
-        if (tmp.empty() || isalpha(tmp[0]))
-            input.ignore((unsigned)(-1), '\n');
-        else if (tmp[0] == '%')
-            return {res, var_num};
-        else
-        {
-            int value = stoi(tmp);
-            if (value == 0)
-            {
-                res.push_back(cur_clause);
-                cur_clause.clear();
-            }
-            else
-            {
-                var_num = std::max(var_num, abs(value));
-                if (value < 0)
-                    cur_clause.push_back({false, -value});
-                else
-                    cur_clause.push_back({true, value});
-            }
-        }
+        cout << "Policy combination not compiled in. Registered decision/restart/reduction/phase combinations:\n"
+             << registered_policies();
+        return -1;
+    }
+    return exit_code.value();
+}
+
+vector<size_t> parse_projection(const string &list)
+{
+    vector<size_t> projection;
+    size_t begin = 0;
+    while (begin < list.size())
+    {
+        auto end = list.find(',', begin);
+        if (end == string::npos)
+            end = list.size();
+        if (end > begin)
+            projection.push_back(stoul(list.substr(begin, end - begin)));
+        begin = end + 1;
     }
-    return {res, var_num};
+    return projection;
+}
+
+/**
+ * @brief Print the cubes of models as DIMACS-like lines "v <literals> 0", then the number of models they cover.
+ *
+ */
+template <typename Solver>
+void enumerate_models(Solver &sat_solver, const vector<size_t> &projection, optional<size_t> limit)
+{
+    auto start = steady_clock::now();
+    ModelEnumerator<Solver> enumerator(sat_solver, projection);
+    while (!limit.has_value() || enumerator.get_cube_num() < limit.value())
+    {
+        auto cube = enumerator.next();
+        if (!cube.has_value())
+            break;
+        cout << "v";
+        for (auto &literal : cube.value())
+            cout << " " << (literal.first ? "" : "-") << literal.second;
+        cout << " 0\n";
+    }
+    cerr << "[Enumerate] " << enumerator.get_cube_num() << " cubes, "
+         << sat_solver.get_statistics().backjumpNum << " conflicts, "
+         << duration_cast<milliseconds>(steady_clock::now() - start).count() << " ms" << endl;
+    cout << "MODELS " << enumerator.get_model_num().to_string() << endl;
+}
+
+template <typename Solver>
+optional<bool> lookahead_solve(Solver &sat_solver)
+{
+    LookaheadSolver<Solver> lookahead_solver(sat_solver);
+    auto result = lookahead_solver.solve();
+    auto &statistic = lookahead_solver.get_statistics();
+    std::chrono::nanoseconds total{0}, longest{0};
+    for (size_t i = 0; i < statistic.rounds.size(); i++)
+    {
+        auto &round = statistic.rounds[i];
+        cerr << "[Lookahead] round " << i << " depth " << round.depth << ": "
+             << round.candidateNum << " candidates, " << round.failedNum << " failed literals, "
+             << round.necessaryNum << " necessary assignments, " << round.doubleLookaheadNum << " double lookaheads, "
+             << duration_cast<microseconds>(round.time).count() << " us" << endl;
+        total += round.time;
+        longest = max(longest, round.time);
+    }
+    cerr << "[Lookahead] " << statistic.nodeNum << " nodes, " << statistic.rounds.size() << " rounds, "
+         << duration_cast<milliseconds>(total).count() << " ms in lookahead, longest round "
+         << duration_cast<microseconds>(longest).count() << " us" << endl;
+    return result;
+}
+
+/**
+ * @brief Print the backbone as a DIMACS-like line "b <literals> 0", and how each candidate literal was decided on stderr.
+ *
+ */
+template <typename Solver>
+void find_backbone(Solver &sat_solver, const vector<size_t> &projection, size_t worker_num, const function<void(Solver &)> &prepare)
+{
+    using Finder = BackboneFinder<Solver>;
+    static const map<typename Finder::Outcome, const char *> outcome_names{
+        {Finder::ASSUMPTION, "backbone by assumption"},
+        {Finder::UNIT, "backbone by level-0 unit"},
+        {Finder::BINARY, "backbone by binary clause"},
+        {Finder::MODEL, "dropped by model"},
+        {Finder::FLIPPED, "dropped by flipping"}};
+    auto start = steady_clock::now();
+    Finder finder(sat_solver, projection);
+    auto result = finder.find(worker_num, prepare);
+    if (!result.has_value() || !result.value())
+    {
+        cout << (result.has_value() ? "UNSAT" : "UNKNOWN") << endl;
+        return;
+    }
+    map<typename Finder::Outcome, size_t> outcome_num;
+    std::chrono::nanoseconds test_time{0};
+    string line = "b";
+    auto &candidates = finder.get_candidates();
+    for (auto &candidate : candidates)
+    {
+        string literal = (candidate.value ? "" : "-") + to_string(candidate.name);
+        cerr << "[Backbone] " << literal << ": " << outcome_names.at(candidate.outcome) << ", "
+             << duration_cast<microseconds>(candidate.time).count() << " us" << endl;
+        outcome_num[candidate.outcome]++;
+        test_time += candidate.time;
+        if (candidate.is_backbone())
+            line += " " + literal;
+    }
+    cerr << "[Backbone] " << candidates.size() << " candidates: "
+         << outcome_num[Finder::ASSUMPTION] + outcome_num[Finder::UNIT] + outcome_num[Finder::BINARY] << " backbone ("
+         << outcome_num[Finder::ASSUMPTION] << " by assumption, " << outcome_num[Finder::UNIT] << " by level-0 unit, "
+         << outcome_num[Finder::BINARY] << " by binary clause), "
+         << outcome_num[Finder::MODEL] + outcome_num[Finder::FLIPPED] << " dropped (" << outcome_num[Finder::MODEL] << " by model, "
+         << outcome_num[Finder::FLIPPED] << " by flipping); " << finder.get_test_num() << " tests on " << worker_num << " workers, "
+         << duration_cast<microseconds>(test_time).count() / max<size_t>(1, candidates.size()) << " us per literal, "
+         << duration_cast<milliseconds>(steady_clock::now() - start).count() << " ms" << endl;
+    cout << line << " 0" << endl;
+}
+
+template <typename Solver>
+void count_models(Solver &sat_solver, const vector<size_t> &projection)
+{
+    auto start = steady_clock::now();
+    ModelCounter<Solver> counter(sat_solver, projection);
+    auto model_num = counter.count();
+    auto statistic = counter.get_statistics();
+    cerr << "[Count] " << statistic.decisionNum << " decisions, "
+         << statistic.componentNum << " components, "
+         << statistic.cacheHitNum << " cache hits, "
+         << duration_cast<milliseconds>(steady_clock::now() - start).count() << " ms" << endl;
+    cout << "MODELS " << model_num.to_string() << endl;
 }
 
 int main(int argc, const char *argv[])
 {
-    if (argc != 2)
+    vector<string> args(argv + 1, argv + argc);
+    bool daemon_mode = false;
+    SolverDaemon::Config daemon_config;
+    optional<string> input_file_name;
+    string cache_path;
+    bool symmetry_breaking = false;
+    bool xor_reasoning = false;
+    PolicyNames policy_names;
+    bool lookahead = false;
+    bool enumerate = false;
+    bool count = false;
+    bool backbone = false;
+    size_t worker_num = 1;
+    optional<vector<size_t>> projection;
+    optional<size_t> limit;
+    string checkpoint_path;
+    seconds checkpoint_interval{60};
+    string resume_path;
+    size_t thread_num = max(1u, thread::hardware_concurrency());
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        bool has_value = i + 1 < args.size();
+        if (args[i] == "--daemon" && has_value)
+        {
+            daemon_mode = true;
+            daemon_config.socket_path = args[++i];
+        }
+        else if (args[i] == "--workers" && has_value)
+            daemon_config.worker_num = worker_num = max<size_t>(1, stoul(args[++i]));
+        else if (args[i] == "--queue-size" && has_value)
+            daemon_config.queue_capacity = stoul(args[++i]);
+        else if (args[i] == "--cache" && has_value)
+            cache_path = args[++i];
+        else if (args[i] == "--symmetry")
+            symmetry_breaking = true;
+        else if (args[i] == "--xor")
+            xor_reasoning = true;
+        else if (args[i] == "--decision" && has_value)
+            policy_names.decision = args[++i];
+        else if (args[i] == "--restart" && has_value)
+            policy_names.restart = args[++i];
+        else if (args[i] == "--reduction" && has_value)
+            policy_names.reduction = args[++i];
+        else if (args[i] == "--phase" && has_value)
+            policy_names.phase = args[++i];
+        else if (args[i] == "--lookahead")
+            lookahead = true;
+        else if (args[i] == "--checkpoint" && has_value)
+            checkpoint_path = args[++i];
+        else if (args[i] == "--checkpoint-interval" && has_value)
+            checkpoint_interval = seconds(stoul(args[++i]));
+        else if (args[i] == "--resume" && has_value)
+            resume_path = args[++i];
+        else if (args[i] == "--threads" && has_value)
+            thread_num = max<size_t>(1, stoul(args[++i]));
+        else if (args[i] == "--enumerate")
+            enumerate = true;
+        else if (args[i] == "--count")
+            count = true;
+        else if (args[i] == "--backbone")
+            backbone = true;
+        else if (args[i] == "--project" && has_value)
+            projection = parse_projection(args[++i]);
+        else if (args[i] == "--limit" && has_value)
+            limit = stoul(args[++i]);
+        else if (args[i].rfind("--", 0) == 0 || input_file_name.has_value())
+        {
+            print_usage();
+            return 0;
+        }
+        else
+            input_file_name = args[i];
+    }
+
+    if (daemon_mode)
     {
-        cout << "Usage: sat_solver [file]\nfile should be in .cnf format\n";
+        daemon_config.cache_path = cache_path;
+        return SolverDaemon(daemon_config).run();
+    }
+
+    if (!input_file_name.has_value())
+    {
+        print_usage();
         return 0;
     }
-    string input_file_name = argv[1];
-    ifstream input(input_file_name);
+    ifstream input(input_file_name.value(), ios::binary);
     if (!input)
     {
         cout << "Failed to open input file" << endl;
         return -1;
     }
-    auto test = DIMACS2vec(input);
-    SATSolver sat_solver;
-    sat_solver.initiate(test.first.begin(), test.first.end());
-    bool solver_result = sat_solver.solve();
+    auto parse_start = steady_clock::now();
+    string buffer(istreambuf_iterator<char>(input), {});
+    vector<CardinalityConstraint> cardinality_constraints;
+    auto test = parse_dimacs(buffer, thread_num, &cardinality_constraints);
+    string().swap(buffer);
+    auto parse_time = steady_clock::now() - parse_start;
+    // Build the solver's clauses on `thread_num` threads, and report the start-up time
+    auto ingest = [&](auto &sat_solver, const CNF &cnf)
+    {
+        auto start = steady_clock::now();
+        sat_solver.initiate_parallel(cnf, thread_num);
+        cerr << "[Ingest] " << cnf.size() << " clauses on " << thread_num << " threads: parsed in "
+             << duration_cast<milliseconds>(parse_time).count() << " ms, initiated in "
+             << duration_cast<milliseconds>(steady_clock::now() - start).count() << " ms" << endl;
+    };
+
+    if (enumerate || count || backbone)
+    {
+        if (!projection.has_value())
+        {
+            projection.emplace();
+            for (int name = 1; name <= test.second; name++)
+                projection->push_back(name);
+        }
+        auto all_models = [&](auto &sat_solver) -> int
+        {
+            ingest(sat_solver, test.first);
+            add_cardinality_constraints(sat_solver, cardinality_constraints);
+            if (xor_reasoning)
+                cerr << "[XOR] " << sat_solver.detect_xors() << " XOR constraints found" << endl;
+            if (backbone)
+            {
+                // The other workers get the formula on their own thread.
+                using Solver = decay_t<decltype(sat_solver)>;
+                auto prepare = [&](Solver &worker_solver)
+                {
+                    worker_solver.initiate_parallel(test.first, 1);
+                    add_cardinality_constraints(worker_solver, cardinality_constraints);
+                    if (xor_reasoning)
+                        worker_solver.detect_xors();
+                };
+                find_backbone<Solver>(sat_solver, projection.value(), worker_num, prepare);
+            }
+            else if (count)
+                count_models(sat_solver, projection.value());
+            else
+                enumerate_models(sat_solver, projection.value(), limit);
+            return 0;
+        };
+        return run_with_policies(policy_names, all_models);
+    }
+
+    optional<ResultCache> cache;
+    optional<ResultCache::Fingerprint> fingerprint;
+    // Neither the fingerprint nor the symmetry detection sees the cardinality constraints.
+    if (!cache_path.empty() && cardinality_constraints.empty())
+    {
+        cache.emplace(cache_path);
+        fingerprint = ResultCache::fingerprint(test.first);
+        auto cached = cache->lookup(test.first, fingerprint.value());
+        cerr << "[Cache] " << (cached.has_value() ? "hit" : "miss") << endl;
+        if (cached.has_value())
+        {
+            for (auto &&assign : cached->second)
+                cerr << assign.first << " = " << assign.second << "\n";
+            cout << (cached->first ? "SAT" : "UNSAT") << endl;
+            return 0;
+        }
+    }
+
+    // The symmetry-breaking clauses are only given to the solver; the result is checked against the original formula.
+    CNF solver_input;
+    const CNF *formula = &test.first;
+    if (symmetry_breaking && cardinality_constraints.empty())
+    {
+        solver_input = test.first;
+        size_t next_var_name = test.second + 1;
+        auto report = break_symmetries(solver_input, next_var_name);
+        cerr << "[Symmetry] " << report.generator_num << " generators, "
+             << report.clause_num << " clauses added, "
+             << duration_cast<milliseconds>(report.time_cost).count() << " ms" << endl;
+        formula = &solver_input;
+    }
+
+    // A snapshot is only resumed on the formula it was written for (symmetry-breaking clauses included).
+    uint64_t snapshot_key = formula_key(*formula, cardinality_constraints);
 
-    // Check the assignment really satisfies the formula
-    if (solver_result)
+    // The solver type depends on the policies, so the rest runs in a generic lambda instantiated for each registered combination.
+    auto solve_with = [&](auto &sat_solver) -> int
     {
-        auto result_assignment = sat_solver.get_result();
-        bool formula_value = true;
-        for (auto &clause : test.first)
+        optional<string> snapshot;
+        if (!resume_path.empty())
         {
-            bool cur_clause_assign = false;
-            for (auto &literal : clause)
+            snapshot = Checkpointer::read(resume_path, snapshot_key);
+            if (!snapshot.has_value())
+                cerr << "[Checkpoint] no snapshot to resume from " << resume_path << ", starting afresh" << endl;
+        }
+        bool resumed = false;
+        if (snapshot.has_value())
+        {
+            try
             {
-                cur_clause_assign |= !(literal.first ^ result_assignment[literal.second]);
+                sat_solver.load_snapshot(snapshot.value());
+                resumed = true;
+                auto statistic = sat_solver.get_statistics();
+                cerr << "[Checkpoint] resumed from " << resume_path << " after " << statistic.decisionNum << " decisions, "
+                     << statistic.backjumpNum << " conflicts" << endl;
             }
-            formula_value &= cur_clause_assign;
+            catch (const invalid_argument &error)
+            {
+                cerr << "[Checkpoint] cannot resume from " << resume_path << ": " << error.what() << endl;
+            }
+        }
+        if (!resumed)
+            ingest(sat_solver, *formula);
+        add_cardinality_constraints(sat_solver, cardinality_constraints);
+        if (xor_reasoning)
+            cerr << "[XOR] " << sat_solver.detect_xors() << " XOR constraints found" << endl;
+
+        // Written by a background thread; the destructor waits for the last snapshot.
+        optional<Checkpointer> checkpointer;
+        if (!checkpoint_path.empty())
+        {
+            checkpointer.emplace(checkpoint_path, snapshot_key);
+            sat_solver.set_checkpoint(checkpoint_interval, [&](string &&snapshot)
+                                      { checkpointer->submit(std::move(snapshot)); });
+            sat_solver.set_terminate([]()
+                                     { return stop_requested != 0; });
+            signal(SIGTERM, request_stop);
+            signal(SIGINT, request_stop);
         }
-        if (formula_value != solver_result)
+
+        auto solver_result = lookahead ? lookahead_solve(sat_solver) : sat_solver.solve({});
+        if (!solver_result.has_value())
         {
-            cout << "Assertion on result fails" << endl;
-            return -1;
+            checkpointer->submit(sat_solver.save_snapshot());
+            cerr << "[Checkpoint] interrupted, search state saved to " << checkpoint_path << endl;
+            cout << "UNKNOWN" << endl;
+            return 0;
         }
-        for (auto &&assign : result_assignment)
+        if (xor_reasoning)
+            cerr << "[XOR] elimination time: " << duration_cast<milliseconds>(sat_solver.get_statistics().xor_elimination_time).count() << " ms" << endl;
+
+        // Check the assignment really satisfies the formula
+        unordered_map<size_t, bool> result_assignment;
+        if (solver_result.value())
         {
-            cerr << assign.first << " = " << assign.second << "\n";
+            result_assignment = sat_solver.get_result();
+            if (!check_assignment(test.first, result_assignment) || !check_assignment(cardinality_constraints, result_assignment))
+            {
+                cout << "Assertion on result fails" << endl;
+                return -1;
+            }
+            // Drop auxiliary variables
+            for (auto iter = result_assignment.begin(); iter != result_assignment.end();)
+                iter = iter->first > static_cast<size_t>(test.second) ? result_assignment.erase(iter) : next(iter);
+            for (auto &&assign : result_assignment)
+            {
+                cerr << assign.first << " = " << assign.second << "\n";
+            }
         }
-    }
-    cout << (solver_result ? "SAT" : "UNSAT") << endl;
-}
\ No newline at end of file
+        if (cache.has_value())
+            cache->store(fingerprint.value(), solver_result.value(), result_assignment);
+        cout << (solver_result.value() ? "SAT" : "UNSAT") << endl;
+        return 0;
+    };
+    return run_with_policies(policy_names, solve_with);
+}
@@ -0,0 +1,652 @@
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <cstddef>
+#include <cmath>
+#include "snapshot.hpp"
+#include "utility.hpp"
+
+#ifndef SAT_POLICIES
+#define SAT_POLICIES
+
+using namespace std;
+
+/**
+ * @brief Strategies plugged into `BasicSATSolver` as template parameters, so that the calls in the search loop are resolved at compile time.
+ *
+ * A decision policy provides
+ *     void add_variable();                               // a new variable, whose ID is the number of variables so far
+ *     void on_assign(size_t variableID);
+ *     void on_unassign(size_t variableID);
+ *     void on_conflict_variable(size_t variableID);      // a variable of the learnt clause
+ *     void on_conflict();                                // after the variables of the learnt clause
+ *     size_t pick(const unordered_set<size_t> &unassigned);
+ *
+ * A phase policy provides
+ *     void add_variable();
+ *     void on_unassign(size_t variableID, bool value);
+ *     bool phase(size_t variableID);
+ *
+ * A restart policy provides
+ *     bool on_conflict();                                // true if the search should restart
+ *
+ * A reduction policy provides
+ *     void on_learnt(size_t clauseID, size_t size, size_t lbd);
+ *     bool on_conflict();                                // true if the learnt clauses should be reduced
+ *     vector<size_t> reduce(IsLocked is_locked);         // the learnt clauses to remove
+ *
+ * Every policy provides
+ *     void save(SnapshotWriter &) const;                 // its state, for checkpoints
+ *     void load(SnapshotReader &);                       // throws `invalid_argument` if the state does not fit the variables
+ *
+ * Each policy has a `name`, which is used by the registry.
+ *
+ */
+
+/**
+ * @brief Binary max-heap of variables ordered by an external score.
+ *
+ */
+class VariableHeap
+{
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    vector<size_t> heap;
+    // position[v] is the index of v in `heap`, npos if v is not in the heap
+    vector<size_t> position;
+
+    void sift_up(size_t i, const vector<double> &score)
+    {
+        auto v = heap[i];
+        while (i > 0 && score[heap[(i - 1) / 2]] < score[v])
+        {
+            heap[i] = heap[(i - 1) / 2];
+            position[heap[i]] = i;
+            i = (i - 1) / 2;
+        }
+        heap[i] = v;
+        position[v] = i;
+    }
+
+    void sift_down(size_t i, const vector<double> &score)
+    {
+        auto v = heap[i];
+        while (2 * i + 1 < heap.size())
+        {
+            size_t child = 2 * i + 1;
+            if (child + 1 < heap.size() && score[heap[child]] < score[heap[child + 1]])
+                child++;
+            if (!(score[v] < score[heap[child]]))
+                break;
+            heap[i] = heap[child];
+            position[heap[i]] = i;
+            i = child;
+        }
+        heap[i] = v;
+        position[v] = i;
+    }
+
+public:
+    bool empty() const
+    {
+        return heap.empty();
+    }
+
+    bool contains(size_t v) const
+    {
+        return v < position.size() && position[v] != npos;
+    }
+
+    void insert(size_t v, const vector<double> &score)
+    {
+        if (v >= position.size())
+            position.resize(v + 1, npos);
+        if (contains(v))
+            return;
+        position[v] = heap.size();
+        heap.push_back(v);
+        sift_up(heap.size() - 1, score);
+    }
+
+    /**
+     * @brief Restore the order after the score of `v` changed.
+     *
+     */
+    void update(size_t v, const vector<double> &score)
+    {
+        if (!contains(v))
+            return;
+        sift_up(position[v], score);
+        sift_down(position[v], score);
+    }
+
+    /**
+     * @brief Restore the order after all the scores changed.
+     *
+     */
+    void reorder(const vector<double> &score)
+    {
+        for (size_t v = 0; v < position.size(); v++)
+            update(v, score);
+    }
+
+    size_t pop(const vector<double> &score)
+    {
+        auto top = heap.front();
+        position[top] = npos;
+        heap.front() = heap.back();
+        heap.pop_back();
+        if (!heap.empty())
+        {
+            position[heap.front()] = 0;
+            sift_down(0, score);
+        }
+        return top;
+    }
+};
+
+/**
+ * @brief Load a vector saved by a policy, which must have one element per variable like `current`.
+ *
+ */
+template <typename T>
+void load_per_variable(SnapshotReader &in, vector<T> &current)
+{
+    vector<T> loaded;
+    in.read(loaded);
+    if (loaded.size() != current.size())
+        throw invalid_argument("policy state does not match the variables");
+    current = std::move(loaded);
+}
+
+/**
+ * @brief The first unassigned variable in the order of the hash set.
+ *
+ */
+struct FirstUnassigned
+{
+    static constexpr const char *name = "first";
+
+    void add_variable() {}
+    void on_assign(size_t) {}
+    void on_unassign(size_t) {}
+    void on_conflict_variable(size_t) {}
+    void on_conflict() {}
+    void save(SnapshotWriter &) const {}
+    void load(SnapshotReader &) {}
+
+    size_t pick(const unordered_set<size_t> &unassigned)
+    {
+        return *unassigned.begin();
+    }
+};
+
+/**
+ * @brief The variable of the highest activity. The variables of each learnt clause are bumped, and all the activities decay after each conflict.
+ *
+ */
+struct VSIDS
+{
+    static constexpr const char *name = "vsids";
+
+    vector<double> activity;
+    double increment = 1;
+    double decay = 0.95;
+    VariableHeap heap;
+
+    void add_variable()
+    {
+        activity.push_back(0);
+        heap.insert(activity.size() - 1, activity);
+    }
+
+    void on_assign(size_t) {}
+
+    void on_unassign(size_t variableID)
+    {
+        heap.insert(variableID, activity);
+    }
+
+    void on_conflict_variable(size_t variableID)
+    {
+        activity[variableID] += increment;
+        if (activity[variableID] > 1e100)
+        {
+            for (auto &a : activity)
+                a *= 1e-100;
+            increment *= 1e-100;
+        }
+        heap.update(variableID, activity);
+    }
+
+    void on_conflict()
+    {
+        increment /= decay;
+    }
+
+    void save(SnapshotWriter &out) const
+    {
+        out.write(activity);
+        out.write(increment);
+    }
+
+    void load(SnapshotReader &in)
+    {
+        load_per_variable(in, activity);
+        increment = in.read<double>();
+        heap.reorder(activity);
+    }
+
+    size_t pick(const unordered_set<size_t> &unassigned)
+    {
+        while (!heap.empty())
+        {
+            auto v = heap.pop(activity);
+            if (unassigned.count(v))
+                return v;
+        }
+        return *unassigned.begin();
+    }
+};
+
+/**
+ * @brief Conflict History-based Branching: the score of a variable is an exponential moving average of rewards,
+ * which are larger for the variables that took part in recent conflicts.
+ *
+ */
+struct CHB
+{
+    static constexpr const char *name = "chb";
+
+    vector<double> q;
+    vector<size_t> last_conflict;
+    size_t conflict_num = 0;
+    double alpha = 0.4;
+    VariableHeap heap;
+
+    void reward(size_t variableID, double multiplier)
+    {
+        // `last_conflict` is ahead of `conflict_num` for the variables of the conflict being analyzed, which `on_conflict` counts afterwards.
+        double age = max(0.0, static_cast<double>(conflict_num) - static_cast<double>(last_conflict[variableID]));
+        double r = multiplier / (age + 1);
+        q[variableID] = (1 - alpha) * q[variableID] + alpha * r;
+        claim(isfinite(q[variableID]));
+        heap.update(variableID, q);
+    }
+
+    void add_variable()
+    {
+        q.push_back(0);
+        last_conflict.push_back(0);
+        heap.insert(q.size() - 1, q);
+    }
+
+    void on_assign(size_t variableID)
+    {
+        reward(variableID, 0.9);
+    }
+
+    void on_unassign(size_t variableID)
+    {
+        heap.insert(variableID, q);
+    }
+
+    void on_conflict_variable(size_t variableID)
+    {
+        last_conflict[variableID] = conflict_num + 1;
+        reward(variableID, 1.0);
+    }
+
+    void on_conflict()
+    {
+        conflict_num++;
+        alpha = max(0.06, alpha - 1e-6);
+    }
+
+    void save(SnapshotWriter &out) const
+    {
+        out.write(q);
+        out.write(last_conflict);
+        out.write<uint64_t>(conflict_num);
+        out.write(alpha);
+    }
+
+    void load(SnapshotReader &in)
+    {
+        load_per_variable(in, q);
+        load_per_variable(in, last_conflict);
+        conflict_num = in.read<uint64_t>();
+        alpha = in.read<double>();
+        heap.reorder(q);
+    }
+
+    size_t pick(const unordered_set<size_t> &unassigned)
+    {
+        while (!heap.empty())
+        {
+            auto v = heap.pop(q);
+            if (unassigned.count(v))
+                return v;
+        }
+        return *unassigned.begin();
+    }
+};
+
+/**
+ * @brief Variable Move-To-Front: the variables of each learnt clause move to the front of the queue; the front-most unassigned variable is picked.
+ * The queue is kept as a heap of bump timestamps.
+ *
+ */
+struct VMTF
+{
+    static constexpr const char *name = "vmtf";
+
+    vector<double> stamp;
+    double clock = 0;
+    VariableHeap heap;
+
+    void add_variable()
+    {
+        stamp.push_back(0);
+        heap.insert(stamp.size() - 1, stamp);
+    }
+
+    void on_assign(size_t) {}
+
+    void on_unassign(size_t variableID)
+    {
+        heap.insert(variableID, stamp);
+    }
+
+    void on_conflict_variable(size_t variableID)
+    {
+        stamp[variableID] = ++clock;
+        heap.update(variableID, stamp);
+    }
+
+    void on_conflict() {}
+
+    void save(SnapshotWriter &out) const
+    {
+        out.write(stamp);
+        out.write(clock);
+    }
+
+    void load(SnapshotReader &in)
+    {
+        load_per_variable(in, stamp);
+        clock = in.read<double>();
+        heap.reorder(stamp);
+    }
+
+    size_t pick(const unordered_set<size_t> &unassigned)
+    {
+        while (!heap.empty())
+        {
+            auto v = heap.pop(stamp);
+            if (unassigned.count(v))
+                return v;
+        }
+        return *unassigned.begin();
+    }
+};
+
+struct AlwaysTrue
+{
+    static constexpr const char *name = "true";
+
+    void add_variable() {}
+    void on_unassign(size_t, bool) {}
+    void save(SnapshotWriter &) const {}
+    void load(SnapshotReader &) {}
+    bool phase(size_t) { return true; }
+};
+
+struct AlwaysFalse
+{
+    static constexpr const char *name = "false";
+
+    void add_variable() {}
+    void on_unassign(size_t, bool) {}
+    void save(SnapshotWriter &) const {}
+    void load(SnapshotReader &) {}
+    bool phase(size_t) { return false; }
+};
+
+/**
+ * @brief A variable is decided to the value it had when it was last unassigned.
+ *
+ */
+struct PhaseSaving
+{
+    static constexpr const char *name = "saving";
+
+    vector<bool> saved;
+
+    void add_variable()
+    {
+        saved.push_back(false);
+    }
+
+    void on_unassign(size_t variableID, bool value)
+    {
+        saved[variableID] = value;
+    }
+
+    bool phase(size_t variableID)
+    {
+        return saved[variableID];
+    }
+
+    void save(SnapshotWriter &out) const
+    {
+        out.write(saved);
+    }
+
+    void load(SnapshotReader &in)
+    {
+        load_per_variable(in, saved);
+    }
+};
+
+struct NoRestart
+{
+    static constexpr const char *name = "none";
+
+    bool on_conflict() { return false; }
+    void save(SnapshotWriter &) const {}
+    void load(SnapshotReader &) {}
+};
+
+/**
+ * @brief Restart after unit * luby(i) conflicts, where luby = 1, 1, 2, 1, 1, 2, 4, ...
+ *
+ */
+struct LubyRestart
+{
+    static constexpr const char *name = "luby";
+
+    size_t unit = 100;
+    size_t index = 0;
+    size_t countdown = 100;
+
+    // The i-th (0-based) element of the Luby sequence
+    static size_t luby(size_t i)
+    {
+        size_t size = 1, seq = 0;
+        while (size < i + 1)
+        {
+            seq++;
+            size = 2 * size + 1;
+        }
+        while (size - 1 != i)
+        {
+            size = (size - 1) >> 1;
+            seq--;
+            i = i % size;
+        }
+        return size_t(1) << seq;
+    }
+
+    bool on_conflict()
+    {
+        if (--countdown != 0)
+            return false;
+        countdown = unit * luby(++index);
+        return true;
+    }
+
+    void save(SnapshotWriter &out) const
+    {
+        out.write<uint64_t>(index);
+        out.write<uint64_t>(countdown);
+    }
+
+    void load(SnapshotReader &in)
+    {
+        index = in.read<uint64_t>();
+        countdown = in.read<uint64_t>();
+    }
+};
+
+/**
+ * @brief Restart after 100, 150, 225, ... conflicts.
+ *
+ */
+struct GeometricRestart
+{
+    static constexpr const char *name = "geometric";
+
+    double limit = 100;
+    double factor = 1.5;
+    size_t countdown = 100;
+
+    bool on_conflict()
+    {
+        if (--countdown != 0)
+            return false;
+        limit *= factor;
+        countdown = static_cast<size_t>(limit);
+        return true;
+    }
+
+    void save(SnapshotWriter &out) const
+    {
+        out.write(limit);
+        out.write<uint64_t>(countdown);
+    }
+
+    void load(SnapshotReader &in)
+    {
+        limit = in.read<double>();
+        countdown = in.read<uint64_t>();
+    }
+};
+
+struct NoReduction
+{
+    static constexpr const char *name = "none";
+
+    void on_learnt(size_t, size_t, size_t) {}
+    bool on_conflict() { return false; }
+    void save(SnapshotWriter &) const {}
+    void load(SnapshotReader &) {}
+
+    template <typename IsLocked>
+    vector<size_t> reduce(IsLocked)
+    {
+        return {};
+    }
+};
+
+/**
+ * @brief Every `interval` conflicts (growing by `increment`), remove the half of the learnt clauses with the largest LBD
+ * (number of distinct decision levels when learnt). Clauses with LBD <= 2 and reasons of current assignments are kept.
+ *
+ */
+struct LBDReduction
+{
+    static constexpr const char *name = "lbd";
+
+    size_t interval = 2000;
+    size_t increment = 300;
+    size_t countdown = 2000;
+    unordered_map<size_t, size_t> lbd;
+
+    void on_learnt(size_t clauseID, size_t, size_t clause_lbd)
+    {
+        if (clause_lbd > 2)
+            lbd[clauseID] = clause_lbd;
+    }
+
+    bool on_conflict()
+    {
+        if (--countdown != 0)
+            return false;
+        interval += increment;
+        countdown = interval;
+        return true;
+    }
+
+    void save(SnapshotWriter &out) const
+    {
+        out.write<uint64_t>(interval);
+        out.write<uint64_t>(countdown);
+        // (clause, LBD) pairs, flattened
+        vector<uint64_t> entries;
+        for (auto &id_lbd : lbd)
+        {
+            entries.push_back(id_lbd.first);
+            entries.push_back(id_lbd.second);
+        }
+        out.write(entries);
+    }
+
+    void load(SnapshotReader &in)
+    {
+        interval = in.read<uint64_t>();
+        countdown = in.read<uint64_t>();
+        vector<uint64_t> entries;
+        in.read(entries);
+        lbd.clear();
+        for (size_t i = 0; i + 1 < entries.size(); i += 2)
+            lbd[entries[i]] = entries[i + 1];
+    }
+
+    template <typename IsLocked>
+    vector<size_t> reduce(IsLocked is_locked)
+    {
+        vector<pair<size_t, size_t>> candidates;
+        for (auto &id_lbd : lbd)
+            if (!is_locked(id_lbd.first))
+                candidates.push_back({id_lbd.second, id_lbd.first});
+        // The largest LBD first; the oldest first among equal LBDs.
+        sort(candidates.begin(), candidates.end(), [](const pair<size_t, size_t> &lhs, const pair<size_t, size_t> &rhs)
+             { return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second; });
+        vector<size_t> removed;
+        for (size_t i = 0; i < candidates.size() / 2; i++)
+        {
+            removed.push_back(candidates[i].second);
+            lbd.erase(candidates[i].second);
+        }
+        return removed;
+    }
+};
+
+/**
+ * @brief A combination of policies
+ *
+ */
+template <typename Decision, typename Restart, typename Reduction, typename Phase>
+struct SolverPolicies
+{
+    using DecisionPolicy = Decision;
+    using RestartPolicy = Restart;
+    using ReductionPolicy = Reduction;
+    using PhasePolicy = Phase;
+};
+
+using DefaultPolicies = SolverPolicies<VSIDS, LubyRestart, LBDReduction, PhaseSaving>;
+
+#endif
@@ -0,0 +1,99 @@
+#include <string>
+#include <tuple>
+#include <optional>
+#include "sat_solver.hpp"
+
+#ifndef POLICY_REGISTRY
+#define POLICY_REGISTRY
+
+using namespace std;
+
+/**
+ * @brief The policy combinations compiled into the solver: X(Decision, Restart, Reduction, Phase).
+ * sat_solver.cpp and xor_propagator.cpp instantiate `BasicSATSolver` for each of them, and `dispatch_policies` picks among them at runtime.
+ *
+ * Every policy is registered with the defaults for the other 3, so that each option can be changed alone;
+ * compiling in all the combinations would multiply the build time by 12.
+ *
+ * NOTE `DefaultPolicies` should be the first entry.
+ *
+ */
+#define SAT_REGISTERED_POLICIES(X)                                 \
+    X(VSIDS, LubyRestart, LBDReduction, PhaseSaving)               \
+    X(CHB, LubyRestart, LBDReduction, PhaseSaving)                 \
+    X(VMTF, LubyRestart, LBDReduction, PhaseSaving)                \
+    X(FirstUnassigned, LubyRestart, LBDReduction, PhaseSaving)     \
+    X(VSIDS, GeometricRestart, LBDReduction, PhaseSaving)          \
+    X(VSIDS, NoRestart, LBDReduction, PhaseSaving)                 \
+    X(VSIDS, LubyRestart, NoReduction, PhaseSaving)                \
+    X(VSIDS, LubyRestart, LBDReduction, AlwaysTrue)                \
+    X(VSIDS, LubyRestart, LBDReduction, AlwaysFalse)               \
+    X(VSIDS, NoRestart, NoReduction, PhaseSaving)                  \
+    X(FirstUnassigned, NoRestart, NoReduction, AlwaysTrue)
+
+#define SAT_POLICIES_TYPE(Decision, Restart, Reduction, Phase) , SolverPolicies<Decision, Restart, Reduction, Phase>
+
+struct PolicyNames
+{
+    string decision = DefaultPolicies::DecisionPolicy::name;
+    string restart = DefaultPolicies::RestartPolicy::name;
+    string reduction = DefaultPolicies::ReductionPolicy::name;
+    string phase = DefaultPolicies::PhasePolicy::name;
+};
+
+template <typename Policies>
+bool match_policies(const PolicyNames &names)
+{
+    return names.decision == Policies::DecisionPolicy::name &&
+           names.restart == Policies::RestartPolicy::name &&
+           names.reduction == Policies::ReductionPolicy::name &&
+           names.phase == Policies::PhasePolicy::name;
+}
+
+template <typename Policies>
+string policies_to_string()
+{
+    return string(Policies::DecisionPolicy::name) + "/" + Policies::RestartPolicy::name + "/" +
+           Policies::ReductionPolicy::name + "/" + Policies::PhasePolicy::name;
+}
+
+template <typename Visitor, typename First, typename... Rest>
+optional<int> dispatch_policies_in(const PolicyNames &names, Visitor &&visitor)
+{
+    if (match_policies<First>(names))
+    {
+        BasicSATSolver<First> sat_solver;
+        return visitor(sat_solver);
+    }
+    if constexpr (sizeof...(Rest) != 0)
+        return dispatch_policies_in<Visitor, Rest...>(names, std::forward<Visitor>(visitor));
+    else
+        return nullopt;
+}
+
+/**
+ * @brief Call `visitor(sat_solver)` with a fresh `BasicSATSolver` of the registered combination named by `names`.
+ *
+ * @return optional<int> the result of the visitor, nullopt if the combination is not registered
+ */
+template <typename Visitor>
+optional<int> dispatch_policies(const PolicyNames &names, Visitor &&visitor)
+{
+    return dispatch_policies_in<Visitor SAT_REGISTERED_POLICIES(SAT_POLICIES_TYPE)>(names, std::forward<Visitor>(visitor));
+}
+
+/**
+ * @brief The registered combinations, as "decision/restart/reduction/phase", one per line.
+ *
+ */
+inline string registered_policies()
+{
+    string result;
+#define SAT_POLICIES_NAME(Decision, Restart, Reduction, Phase) \
+    result += "  " + policies_to_string<SolverPolicies<Decision, Restart, Reduction, Phase>>() + "\n";
+    SAT_REGISTERED_POLICIES(SAT_POLICIES_NAME)
+#undef SAT_POLICIES_NAME
+    return result;
+}
+
+#endif
@@ -0,0 +1,390 @@
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "result_cache.hpp"
+#include "utility.hpp"
+
+namespace
+{
+    // Order-independent hash of a multiset
+    uint64_t combine_sorted(uint64_t seed, vector<uint64_t> &values)
+    {
+        sort(values.begin(), values.end());
+        for (auto value : values)
+            seed = hash_combine(seed, value);
+        return seed;
+    }
+
+    class FileLock
+    {
+        int fd;
+
+    public:
+        FileLock(int fd, int operation) : fd(fd) { flock(fd, operation); }
+        ~FileLock() { flock(fd, LOCK_UN); }
+    };
+
+    constexpr char magic[8] = {'S', 'A', 'T', 'C', 'A', 'C', 'H', 'E'};
+    constexpr uint32_t version = 2;
+    constexpr uint32_t bucket_num = 1 << 14;
+    constexpr size_t max_probe = 64;
+
+    enum BucketState : uint32_t
+    {
+        EMPTY,
+        CACHED_SAT,
+        CACHED_UNSAT,
+    };
+}
+
+struct ResultCache::Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t bucket_num;
+    // End of the data region, which follows the buckets
+    uint64_t data_end;
+};
+
+struct ResultCache::Bucket
+{
+    uint64_t key;
+    uint64_t digest;
+    // The model of a SAT entry, or the canonical clauses of an UNSAT entry
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint32_t var_num;
+    uint32_t state;
+};
+
+const size_t ResultCache::data_begin = sizeof(Header) + sizeof(Bucket) * bucket_num;
+
+/**
+ * @brief Colour refinement on the literals: a literal is coloured by its complement and by the colours of the clauses it occurs in,
+ * a clause by the colours of its literals. The result does not depend on names or orders.
+ *
+ */
+ResultCache::Fingerprint ResultCache::fingerprint(const CNF &cnf)
+{
+    unordered_map<size_t, size_t> dense_id;
+    vector<size_t> names;
+    // Literal `2 * v + 1` is the negation of literal `2 * v`
+    vector<vector<size_t>> clauses;
+    for (auto &clause : cnf)
+    {
+        vector<size_t> literals;
+        for (auto &literal : clause)
+        {
+            auto res = dense_id.insert({literal.second, names.size()});
+            if (res.second)
+                names.push_back(literal.second);
+            literals.push_back(2 * res.first->second + !literal.first);
+        }
+        sort(literals.begin(), literals.end());
+        literals.erase(unique(literals.begin(), literals.end()), literals.end());
+        clauses.push_back(std::move(literals));
+    }
+
+    size_t var_num = names.size();
+    vector<vector<size_t>> occurrences(2 * var_num);
+    for (size_t c = 0; c < clauses.size(); c++)
+        for (auto literal : clauses[c])
+            occurrences[literal].push_back(c);
+
+    vector<uint64_t> literal_color(2 * var_num, 1), clause_color(clauses.size());
+    vector<uint64_t> var_color(var_num), buffer;
+    auto color_clauses = [&]()
+    {
+        for (size_t c = 0; c < clauses.size(); c++)
+        {
+            buffer.clear();
+            for (auto literal : clauses[c])
+                buffer.push_back(literal_color[literal]);
+            clause_color[c] = combine_sorted(clauses[c].size(), buffer);
+        }
+    };
+    size_t distinct_colors = 0;
+    for (size_t round = 0; round < 32; round++)
+    {
+        color_clauses();
+        vector<uint64_t> new_color(2 * var_num);
+        for (size_t literal = 0; literal < 2 * var_num; literal++)
+        {
+            buffer.clear();
+            for (auto c : occurrences[literal])
+                buffer.push_back(clause_color[c]);
+            new_color[literal] = hash_combine(combine_sorted(literal_color[literal], buffer), literal_color[literal ^ 1]);
+        }
+        literal_color = std::move(new_color);
+        for (size_t v = 0; v < var_num; v++)
+            var_color[v] = hash_combine(literal_color[2 * v], literal_color[2 * v + 1]);
+        buffer = var_color;
+        sort(buffer.begin(), buffer.end());
+        size_t cur_distinct = unique(buffer.begin(), buffer.end()) - buffer.begin();
+        if (cur_distinct == distinct_colors)
+            break;
+        distinct_colors = cur_distinct;
+    }
+    color_clauses();
+
+    Fingerprint fingerprint;
+    fingerprint.key = combine_sorted(hash_combine(var_num, clauses.size()), clause_color);
+
+    // Ties between variables of the same colour are broken by their names.
+    vector<size_t> order(var_num);
+    for (size_t v = 0; v < var_num; v++)
+        order[v] = v;
+    sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs)
+         { return var_color[lhs] != var_color[rhs] ? var_color[lhs] < var_color[rhs] : names[lhs] < names[rhs]; });
+    vector<size_t> rank(var_num);
+    for (size_t r = 0; r < var_num; r++)
+    {
+        rank[order[r]] = r;
+        fingerprint.canonical_order.push_back(names[order[r]]);
+    }
+
+    for (auto &clause : clauses)
+    {
+        for (auto &literal : clause)
+            literal = 2 * rank[literal / 2] + literal % 2;
+        sort(clause.begin(), clause.end());
+    }
+    sort(clauses.begin(), clauses.end());
+    fingerprint.digest = hash_combine(var_num, clauses.size());
+    for (auto &clause : clauses)
+    {
+        fingerprint.digest = hash_combine(fingerprint.digest, clause.size());
+        fingerprint.canonical_clauses.push_back(clause.size());
+        for (auto literal : clause)
+        {
+            fingerprint.digest = hash_combine(fingerprint.digest, literal);
+            fingerprint.canonical_clauses.push_back(literal);
+        }
+    }
+    return fingerprint;
+}
+
+ResultCache::ResultCache(const string &path)
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        cerr << "[Cache] failed to open " << path << endl;
+        return;
+    }
+    FileLock lock(fd, LOCK_EX);
+    struct stat file_stat;
+    fstat(fd, &file_stat);
+    bool fresh = static_cast<size_t>(file_stat.st_size) < data_begin;
+    if (fresh && ftruncate(fd, data_begin) != 0)
+        return;
+    if (!remap(max<size_t>(data_begin, file_stat.st_size)))
+        return;
+    if (fresh)
+    {
+        memcpy(header().magic, magic, sizeof(magic));
+        header().version = version;
+        header().bucket_num = bucket_num;
+        header().data_end = data_begin;
+    }
+    else if (memcmp(header().magic, magic, sizeof(magic)) != 0 || header().version != version || header().bucket_num != bucket_num)
+    {
+        cerr << "[Cache] " << path << " is not a compatible cache file" << endl;
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+    }
+}
+
+ResultCache::~ResultCache()
+{
+    if (mapping != nullptr)
+        munmap(mapping, mapping_size);
+    if (fd >= 0)
+        close(fd);
+}
+
+ResultCache::Header &ResultCache::header()
+{
+    return *reinterpret_cast<Header *>(mapping);
+}
+
+ResultCache::Bucket *ResultCache::buckets()
+{
+    return reinterpret_cast<Bucket *>(mapping + sizeof(Header));
+}
+
+/**
+ * @brief Map the first `size` bytes of the file, or the whole file if another process has grown it.
+ *
+ */
+bool ResultCache::remap(size_t size)
+{
+    struct stat file_stat;
+    fstat(fd, &file_stat);
+    size = max<size_t>(size, file_stat.st_size);
+    if (mapping != nullptr && size == mapping_size)
+        return true;
+    if (mapping != nullptr)
+        munmap(mapping, mapping_size);
+    void *res = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (res == MAP_FAILED)
+    {
+        cerr << "[Cache] mmap failed" << endl;
+        mapping = nullptr;
+        return false;
+    }
+    mapping = static_cast<uint8_t *>(res);
+    mapping_size = size;
+    return true;
+}
+
+/**
+ * @brief Linear probing. A full probe sequence evicts its first bucket on insertion.
+ *
+ */
+ResultCache::Bucket *ResultCache::find(const Fingerprint &fingerprint, bool for_insert)
+{
+    size_t start = hash_combine(fingerprint.key, fingerprint.digest) % bucket_num;
+    for (size_t i = 0; i < max_probe; i++)
+    {
+        auto &bucket = buckets()[(start + i) % bucket_num];
+        if (bucket.state == EMPTY)
+            return for_insert ? &bucket : nullptr;
+        if (bucket.key == fingerprint.key && bucket.digest == fingerprint.digest && bucket.var_num == fingerprint.canonical_order.size())
+            return &bucket;
+    }
+    return for_insert ? &buckets()[start] : nullptr;
+}
+
+/**
+ * @brief Move the data of the occupied buckets to the start of the data region, in their order, dropping the bytes no bucket refers to.
+ *
+ */
+void ResultCache::compact()
+{
+    vector<Bucket *> occupied;
+    for (size_t i = 0; i < bucket_num; i++)
+        if (buckets()[i].state != EMPTY && buckets()[i].data_size > 0)
+            occupied.push_back(&buckets()[i]);
+    sort(occupied.begin(), occupied.end(), [](Bucket *lhs, Bucket *rhs)
+         { return lhs->data_offset < rhs->data_offset; });
+    size_t end = data_begin;
+    for (auto bucket : occupied)
+    {
+        // Each offset is at least `end`, so a move never overwrites data not moved yet.
+        memmove(mapping + end, mapping + bucket->data_offset, bucket->data_size);
+        bucket->data_offset = end;
+        end += bucket->data_size;
+    }
+    header().data_end = end;
+}
+
+/**
+ * @brief Reserve `size` bytes at the end of the data region: compact it first if that frees at least half of it, and grow the file if needed.
+ *
+ * @return the offset of the bytes, or nullopt if the file cannot be grown
+ */
+optional<size_t> ResultCache::allocate(size_t size)
+{
+    if (header().data_end + size > mapping_size)
+    {
+        size_t live = 0;
+        for (size_t i = 0; i < bucket_num; i++)
+            if (buckets()[i].state != EMPTY)
+                live += buckets()[i].data_size;
+        if (2 * live <= header().data_end - data_begin)
+            compact();
+    }
+    size_t offset = header().data_end;
+    if (offset + size > mapping_size)
+    {
+        size_t new_size = max(offset + size, mapping_size * 2);
+        if (ftruncate(fd, new_size) != 0 || !remap(new_size))
+            return nullopt;
+    }
+    header().data_end = offset + size;
+    return offset;
+}
+
+optional<pair<bool, unordered_map<size_t, bool>>> ResultCache::lookup(const CNF &cnf, const Fingerprint &fingerprint)
+{
+    if (!is_open())
+        return nullopt;
+    lock_guard<mutex> guard(cache_mutex);
+    FileLock lock(fd, LOCK_SH);
+    if (!remap(mapping_size))
+        return nullopt;
+
+    auto bucket = find(fingerprint, false);
+    if (bucket == nullptr)
+        return nullopt;
+    if (bucket->data_offset + bucket->data_size > mapping_size)
+        return nullopt;
+    // Equal fingerprints do not prove the formulas are equal: the clauses, or the model, have to be checked.
+    if (bucket->state == CACHED_UNSAT)
+    {
+        auto &clauses = fingerprint.canonical_clauses;
+        if (bucket->data_size != clauses.size() * sizeof(uint32_t) || memcmp(mapping + bucket->data_offset, clauses.data(), bucket->data_size) != 0)
+            return nullopt;
+        return make_pair(false, unordered_map<size_t, bool>{});
+    }
+    if (bucket->data_size != (bucket->var_num + 7) / 8)
+        return nullopt;
+
+    unordered_map<size_t, bool> model;
+    const uint8_t *bits = mapping + bucket->data_offset;
+    for (size_t r = 0; r < bucket->var_num; r++)
+        model[fingerprint.canonical_order[r]] = (bits[r / 8] >> (r % 8)) & 1;
+    if (!check_assignment(cnf, model))
+        return nullopt;
+    return make_pair(true, std::move(model));
+}
+
+void ResultCache::store(const Fingerprint &fingerprint, bool result, const unordered_map<size_t, bool> &model)
+{
+    if (!is_open())
+        return;
+    lock_guard<mutex> guard(cache_mutex);
+    FileLock lock(fd, LOCK_EX);
+    if (!remap(mapping_size))
+        return;
+
+    size_t var_num = fingerprint.canonical_order.size();
+    // Canonical literals have to fit the 32 bits of `canonical_clauses`.
+    if (var_num >= (size_t(1) << 31))
+        return;
+    size_t data_size = result ? (var_num + 7) / 8 : fingerprint.canonical_clauses.size() * sizeof(uint32_t);
+    // The bucket loses its data first, so that a compaction in `allocate` drops the data it replaces.
+    // It keeps its state: an empty bucket would cut the probe sequences through it, should `allocate` fail.
+    // A bucket without its data is a miss in `lookup`, which checks the size of the data.
+    auto bucket = find(fingerprint, true);
+    size_t bucket_index = bucket - buckets();
+    bucket->data_size = 0;
+    auto data_offset = allocate(data_size);
+    if (!data_offset.has_value())
+        return;
+    // `allocate` may have remapped the file.
+    bucket = &buckets()[bucket_index];
+    uint8_t *data = mapping + data_offset.value();
+    if (result)
+    {
+        memset(data, 0, data_size);
+        for (size_t r = 0; r < var_num; r++)
+            if (model.at(fingerprint.canonical_order[r]))
+                data[r / 8] |= 1 << (r % 8);
+    }
+    else
+        memcpy(data, fingerprint.canonical_clauses.data(), data_size);
+
+    bucket->key = fingerprint.key;
+    bucket->digest = fingerprint.digest;
+    bucket->data_offset = data_offset.value();
+    bucket->data_size = data_size;
+    bucket->var_num = var_num;
+    bucket->state = result ? CACHED_SAT : CACHED_UNSAT;
+}
@@ -0,0 +1,78 @@
+#include <string>
+#include <vector>
+#include <optional>
+#include <mutex>
+#include <cstdint>
+#include "dimacs.hpp"
+
+#ifndef RESULT_CACHE
+#define RESULT_CACHE
+
+using namespace std;
+
+/**
+ * @brief A persistent cache of solver results, stored in a memory-mapped file.
+ *
+ * Formulas are keyed by a fingerprint that ignores clause order, literal order and variable renaming.
+ * Models are stored in the canonical variable order of the fingerprint, so that a hit can be mapped back to the names of the query.
+ * UNSAT answers are stored with the canonical clauses, which a hit has to match exactly.
+ * The region of models and clauses is compacted when it runs out of space, to reclaim the entries evicted or overwritten.
+ *
+ */
+class ResultCache
+{
+public:
+    struct Fingerprint
+    {
+        // Invariant under clause order, literal order and variable renaming.
+        uint64_t key;
+        // Hash of the clauses written with canonical variable names.
+        // Equal for renamed formulas when the colour refinement separates all the variables.
+        uint64_t digest;
+        // canonical_order[rank] is the original name of the variable with canonical name `rank`
+        vector<size_t> canonical_order;
+        // The sorted clauses with canonical names, each as its size followed by its sorted literals
+        vector<uint32_t> canonical_clauses;
+    };
+
+    static Fingerprint fingerprint(const CNF &cnf);
+
+private:
+    struct Header;
+    struct Bucket;
+    // The models and the clauses of UNSAT entries follow the header and the buckets.
+    static const size_t data_begin;
+
+    int fd = -1;
+    uint8_t *mapping = nullptr;
+    size_t mapping_size = 0;
+    mutex cache_mutex;
+
+    Header &header();
+    Bucket *buckets();
+    Bucket *find(const Fingerprint &fingerprint, bool for_insert);
+    bool remap(size_t size);
+    void compact();
+    optional<size_t> allocate(size_t size);
+
+public:
+    ResultCache(const string &path);
+    ~ResultCache();
+
+    bool is_open() const
+    {
+        return mapping != nullptr;
+    }
+
+    /**
+     * @brief A cached SAT answer is returned only if its model satisfies `cnf`,
+     * a cached UNSAT answer only if its clauses are those of `fingerprint`.
+     *
+     * @return nullopt on a miss; otherwise the result, and the model for SAT
+     */
+    optional<pair<bool, unordered_map<size_t, bool>>> lookup(const CNF &cnf, const Fingerprint &fingerprint);
+
+    void store(const Fingerprint &fingerprint, bool result, const unordered_map<size_t, bool> &model);
+};
+
+#endif
@@ -1,13 +1,17 @@
 #include "sat_solver.hpp"
+#include "policy_registry.hpp"
 
-SATSolver::Literal::Literal(SATSolver *sat_solver, VariableID variable, bool literal_type) : variableID(variable), sat_solver(sat_solver), literal_type(literal_type) {}
+template <typename Policies>
+BasicSATSolver<Policies>::Literal::Literal(BasicSATSolver *sat_solver, VariableID variable, bool literal_type) : variableID(variable), sat_solver(sat_solver), literal_type(literal_type) {}
 
-VariableValue SATSolver::Literal::get_value() const
+template <typename Policies>
+VariableValue BasicSATSolver<Policies>::Literal::get_value() const
 {
     return get_value_if(sat_solver->get_variable(variableID).value);
 }
 
-VariableValue SATSolver::Literal::get_value_if(VariableValue variableValue) const
+template <typename Policies>
+VariableValue BasicSATSolver<Policies>::Literal::get_value_if(VariableValue variableValue) const
 {
     if (variableValue == VariableValue::UNASSIGNED)
         return UNASSIGNED;
@@ -18,31 +22,37 @@ VariableValue SATSolver::Literal::get_value_if(VariableValue variableValue) cons
     }
 }
 
-SATSolver::VariableID SATSolver::Literal::get_variable_id() const
+template <typename Policies>
+auto BasicSATSolver<Policies>::Literal::get_variable_id() const -> VariableID
 {
     return variableID;
 }
 
-SATSolver::Variable &SATSolver::Literal::get_variable() const
+template <typename Policies>
+auto BasicSATSolver<Policies>::Literal::get_variable() const -> Variable &
 {
     return sat_solver->get_variable(get_variable_id());
 }
 
-bool SATSolver::Literal::get_literal_type() const
+template <typename Policies>
+bool BasicSATSolver<Policies>::Literal::get_literal_type() const
 {
     return literal_type;
 }
 
-SATSolver::Clause::Clause(SATSolver &sat_solver, ClauseID clauseID) : sat_solver(sat_solver), clauseID(clauseID)
+template <typename Policies>
+BasicSATSolver<Policies>::Clause::Clause(BasicSATSolver &sat_solver, ClauseID clauseID) : sat_solver(sat_solver), clauseID(clauseID)
 {
 }
 
-pair<unordered_set<SATSolver::VariableID>::iterator, bool> SATSolver::Variable::add_clause(ClauseID clauseID)
+template <typename Policies>
+auto BasicSATSolver<Policies>::Variable::add_clause(ClauseID clauseID) -> pair<typename unordered_set<ClauseID>::iterator, bool>
 {
     return clauses.insert(clauseID);
 }
 
-bool SATSolver::Clause::add_literal(VariableID variableID, bool literal_type)
+template <typename Policies>
+bool BasicSATSolver<Policies>::Clause::add_literal(VariableID variableID, bool literal_type)
 {
     auto insert_res = literals.insert({variableID, Literal(&sat_solver, variableID, literal_type)});
     if (insert_res.second)
@@ -60,7 +70,8 @@ bool SATSolver::Clause::add_literal(VariableID variableID, bool literal_type)
  * @brief Do not change unipropagation queue
  *
  */
-void SATSolver::Clause::update()
+template <typename Policies>
+void BasicSATSolver<Policies>::Clause::update()
 {
     array<vector<VariableID>, 3> inconsistent_set;
     for (size_t i = 0; i < 3; i++)
@@ -83,14 +94,16 @@ void SATSolver::Clause::update()
     }
 }
 
-void SATSolver::Clause::change_assignment(VariableID variableID, VariableValue from, VariableValue to)
+template <typename Policies>
+void BasicSATSolver<Policies>::Clause::change_assignment(VariableID variableID, VariableValue from, VariableValue to)
 {
     auto &literal = literals[variableID];
     claim(literals_by_value[literal.get_value_if(from)].erase(variableID) == 1);
     claim(literals_by_value[literal.get_value_if(to)].insert(variableID).second);
 }
 
-bool SATSolver::Clause::assign(VariableID variableID, bool b_variableValue)
+template <typename Policies>
+bool BasicSATSolver<Policies>::Clause::assign(VariableID variableID, bool b_variableValue)
 {
     change_assignment(variableID, UNASSIGNED, bool2variableValue(b_variableValue));
     if (to_decide_num() == 1)
@@ -101,27 +114,32 @@ bool SATSolver::Clause::assign(VariableID variableID, bool b_variableValue)
         return true;
 }
 
-void SATSolver::Clause::reset(VariableID variableID)
+template <typename Policies>
+void BasicSATSolver<Policies>::Clause::reset(VariableID variableID)
 {
     change_assignment(variableID, sat_solver.get_variable(variableID).value, UNASSIGNED);
 }
 
-bool SATSolver::Clause::is_conflict()
+template <typename Policies>
+bool BasicSATSolver<Policies>::Clause::is_conflict()
 {
     return literals_by_value[UNASSIGNED].size() == 0 && literals_by_value[TRUE].size() == 0;
 }
 
-SATSolver::Variable::Variable(SATSolver &sat_solver, VariableID variableID) : sat_solver(sat_solver), variableID(variableID), value(VariableValue::UNASSIGNED)
+template <typename Policies>
+BasicSATSolver<Policies>::Variable::Variable(BasicSATSolver &sat_solver, VariableID variableID) : sat_solver(sat_solver), variableID(variableID), value(VariableValue::UNASSIGNED)
 {
 }
 
-void SATSolver::update_clauses()
+template <typename Policies>
+void BasicSATSolver<Policies>::update_clauses()
 {
     for (auto &clause : clauses)
         clause.update();
 }
 
-vector<SATSolver::Index> SATSolver::ImplicationGraph::confilict_analysis(ClauseID conflict_clause)
+template <typename Policies>
+auto BasicSATSolver<Policies>::ImplicationGraph::confilict_analysis(ClauseID conflict_clause) -> vector<Index>
 {
     auto &init_learnt_clause = sat_solver.get_clause(conflict_clause).get_literals();
     // claim(init_learnt_clause.find(stack.back().variableID) != init_learnt_clause.end());
@@ -161,7 +179,33 @@ vector<SATSolver::Index> SATSolver::ImplicationGraph::confilict_analysis(ClauseI
     return learnt_clause_pos;
 }
 
-optional<SATSolver::ClauseID> SATSolver::assign(VariableID variableID, bool b_variableValue)
+template <typename Policies>
+auto BasicSATSolver<Policies>::ImplicationGraph::decision_ancestors(VariableID variableID) -> vector<VariableID>
+{
+    vector<VariableID> decisions;
+    unordered_set<Index> visited{var2pos[variableID]};
+    vector<Index> worklist{var2pos[variableID]};
+    while (!worklist.empty())
+    {
+        auto &node = stack[worklist.back()];
+        worklist.pop_back();
+        if (node.is_decision_node())
+        {
+            decisions.push_back(node.variableID);
+            continue;
+        }
+        for (auto &varID_literal : sat_solver.get_clause(node.derive_from.value()).get_literals())
+        {
+            auto pos = var2pos[varID_literal.first];
+            if (varID_literal.first != node.variableID && visited.insert(pos).second)
+                worklist.push_back(pos);
+        }
+    }
+    return decisions;
+}
+
+template <typename Policies>
+auto BasicSATSolver<Policies>::assign(VariableID variableID, bool b_variableValue) -> optional<ClauseID>
 {
     auto variableValue = bool2variableValue(b_variableValue);
     auto oldValue = get_variable(variableID).value;
@@ -177,11 +221,14 @@ optional<SATSolver::ClauseID> SATSolver::assign(VariableID variableID, bool b_va
             conflict_clause = clauseID;
 
     get_variable(variableID).value = variableValue;
+    decision_policy.on_assign(variableID);
+    cardinality_propagator.on_assign(variableID, b_variableValue);
 
     return conflict_clause;
 }
 
-void SATSolver::reset(VariableID variableID)
+template <typename Policies>
+void BasicSATSolver<Policies>::reset(VariableID variableID)
 {
     auto oldValue = get_variable(variableID).value;
     claim(oldValue != UNASSIGNED);
@@ -195,15 +242,62 @@ void SATSolver::reset(VariableID variableID)
     // Assignment to variable should be after Clause::reset, since Clause::reset uses the value of variables to determine the old value.
     get_variable(variableID)
         .value = UNASSIGNED;
+    decision_policy.on_unassign(variableID);
+    phase_policy.on_unassign(variableID, oldValue == TRUE);
+    cardinality_propagator.on_unassign(variableID, oldValue == TRUE);
+}
+
+template <typename Policies>
+void BasicSATSolver<Policies>::remove_clause(ClauseID clauseID)
+{
+    auto &clause = get_clause(clauseID);
+    for (auto &varID_literal : clause.get_literals())
+        get_variable(varID_literal.first).clauses.erase(clauseID);
+    clause.clear();
+    statistic.removedClauseNum++;
+}
+
+template <typename Policies>
+void BasicSATSolver<Policies>::reduce_learnt_clauses()
+{
+    auto locked = implication_graph.reasons();
+    auto removed = reduction_policy.reduce([&](ClauseID clauseID)
+                                           { return locked.count(clauseID) != 0; });
+    for (auto clauseID : removed)
+        remove_clause(clauseID);
+    log_stream << "[Reduce] " << removed.size() << " learnt clauses removed" << endl;
+}
+
+template <typename Policies>
+void BasicSATSolver<Policies>::backtrack(size_t decision_level)
+{
+    if (implication_graph.get_decision_level() <= decision_level)
+        return;
+    while (implication_graph.get_decision_level() > decision_level)
+    {
+        reset(implication_graph.back().variableID);
+        implication_graph.pop();
+    }
+    unipropagate_queue.clear();
+}
+
+template <typename Policies>
+void BasicSATSolver<Policies>::analyze_final(VariableID variableID)
+{
+    failed_assumptions.clear();
+    for (auto decision : implication_graph.decision_ancestors(variableID))
+        failed_assumptions.insert(VarID2originalName[decision]);
+    failed_assumptions.insert(VarID2originalName[variableID]);
 }
 
 /**
  * @brief NOTE If a conflict occurs, the unipropagation queue may not be consistent.
  * NOTE During the unipropagation, the queue may be inconsistent. e.g, 2 clauses to unipropagate have the same unassigned literal.
  *
- * @return optional<SATSolver::ClauseID>
+ * @return optional<ClauseID>
  */
-optional<SATSolver::ClauseID> SATSolver::unipropagate()
+template <typename Policies>
+auto BasicSATSolver<Policies>::unipropagate() -> optional<ClauseID>
 {
     while (!unipropagate_queue.empty())
     {
@@ -241,45 +335,341 @@ optional<SATSolver::ClauseID> SATSolver::unipropagate()
     return nullopt;
 }
 
-bool SATSolver::solve()
+template <typename Policies>
+auto BasicSATSolver<Policies>::propagate() -> optional<ClauseID>
+{
+    while (true)
+    {
+        auto conflict = unipropagate();
+        if (conflict.has_value())
+            return conflict;
+        if (!xor_propagator.empty() && (conflict = xor_propagator.propagate()).has_value())
+            return conflict;
+        if (!cardinality_propagator.empty() && (conflict = cardinality_propagator.propagate()).has_value())
+            return conflict;
+        if (unipropagate_queue.empty())
+            return nullopt;
+    }
+}
+
+template <typename Policies>
+auto BasicSATSolver<Policies>::add_implied_clause(const vector<pair<VariableID, bool>> &literals) -> ClauseID
+{
+    ClauseID clause_id = clauses.size();
+    Clause clause(*this, clause_id);
+    for (auto &literal : literals)
+    {
+        claim(clause.add_literal(literal.first, literal.second));
+        get_variable(literal.first).add_clause(clause_id);
+    }
+    add_clause(std::move(clause));
+    return clause_id;
+}
+
+template <typename Policies>
+void BasicSATSolver<Policies>::initiate_parallel(const vector<vector<pair<bool, size_t>>> &input, size_t thread_num)
 {
-    if (unipropagate().has_value())
+    backtrack(0);
+    size_t range_num = parallel_range_num(thread_num, input.size(), 1 << 12);
+
+    // Pass 1: the clauses which are not tautologies, and how many of their literals create variables:
+    // like `initiate`, stop at the literal contradicting an earlier one.
+    vector<uint8_t> valid(input.size());
+    vector<size_t> created(input.size());
+    vector<size_t> valid_num(range_num, 0), literal_num(range_num, 0), max_name(range_num, 0);
+    auto check_clauses = [&](size_t range, size_t begin, size_t end)
+    {
+        vector<pair<size_t, bool>> sorted;
+        auto contradicts = [](const pair<size_t, bool> &lhs, const pair<size_t, bool> &rhs)
+        {
+            return lhs.first == rhs.first && lhs.second != rhs.second;
+        };
+        for (size_t c = begin; c < end; c++)
+        {
+            auto &clause = input[c];
+            sorted.clear();
+            for (auto &literal : clause)
+            {
+                sorted.push_back({literal.second, literal.first});
+                max_name[range] = std::max(max_name[range], literal.second);
+            }
+            sort(sorted.begin(), sorted.end());
+            bool tautology = adjacent_find(sorted.begin(), sorted.end(), contradicts) != sorted.end();
+            created[c] = clause.size();
+            if (tautology)
+            {
+                unordered_map<size_t, bool> types;
+                for (size_t i = 0; i < clause.size(); i++)
+                    if (types.insert({clause[i].second, clause[i].first}).first->second != clause[i].first)
+                    {
+                        created[c] = i + 1;
+                        break;
+                    }
+            }
+            valid[c] = !tautology;
+            valid_num[range] += !tautology;
+            literal_num[range] += created[c];
+        }
+    };
+    parallel_for(range_num, input.size(), check_clauses);
+
+    // Names are looked up in a vector rather than in `OriginalName2varID`, unless they are too sparse.
+    constexpr VariableID none = static_cast<VariableID>(-1);
+    size_t name_bound = *max_element(max_name.begin(), max_name.end()) + 1;
+    size_t total_literal_num = 0;
+    for (auto num : literal_num)
+        total_literal_num += num;
+    bool dense = name_bound <= 2 * (total_literal_num + VarID2originalName.size()) + 1024;
+    vector<VariableID> name2id;
+    if (dense)
+    {
+        name2id.assign(name_bound, none);
+        for (auto &name_id : OriginalName2varID)
+            if (name_id.first < name_bound)
+                name2id[name_id.first] = name_id.second;
+    }
+    auto find_id = [&](size_t name)
+    {
+        if (dense)
+            return name2id[name];
+        auto res = OriginalName2varID.find(name);
+        return res == OriginalName2varID.end() ? none : res->second;
+    };
+
+    // Pass 2: the new names of each range, in order of first appearance. Creating them range by range keeps the order of `initiate`.
+    vector<vector<size_t>> new_names(range_num);
+    auto collect_new_names = [&](size_t range, size_t begin, size_t end)
+    {
+        vector<bool> seen_dense(dense ? name_bound : 0, false);
+        unordered_set<size_t> seen_sparse;
+        for (size_t c = begin; c < end; c++)
+            for (size_t i = 0; i < created[c]; i++)
+            {
+                auto name = input[c][i].second;
+                if (find_id(name) != none)
+                    continue;
+                bool first = dense ? !seen_dense[name] : seen_sparse.insert(name).second;
+                if (dense)
+                    seen_dense[name] = true;
+                if (first)
+                    new_names[range].push_back(name);
+            }
+    };
+    parallel_for(range_num, input.size(), collect_new_names);
+    for (auto &names : new_names)
+        for (auto name : names)
+        {
+            auto var_id = get_or_create_variable(name);
+            if (dense)
+                name2id[name] = var_id;
+        }
+
+    // Pass 3: build the clauses, and count the occurrences of each variable in each range.
+    size_t var_num = variables.size();
+    vector<ClauseID> first_id(range_num, clauses.size());
+    for (size_t range = 1; range < range_num; range++)
+        first_id[range] = first_id[range - 1] + valid_num[range - 1];
+    vector<vector<Clause>> built(range_num);
+    vector<vector<uint32_t>> counts(range_num);
+    auto build_clauses = [&](size_t range, size_t begin, size_t end)
+    {
+        auto &count = counts[range];
+        count.assign(var_num, 0);
+        built[range].reserve(valid_num[range]);
+        ClauseID clause_id = first_id[range];
+        for (size_t c = begin; c < end; c++)
+        {
+            if (!valid[c])
+                continue;
+            Clause clause(*this, clause_id++);
+            for (auto &literal : input[c])
+            {
+                auto var_id = find_id(literal.second);
+                clause.add_literal(var_id, literal.first);
+                count[var_id]++;
+            }
+            built[range].push_back(std::move(clause));
+        }
+    };
+    parallel_for(range_num, input.size(), build_clauses);
+
+    // The slice of variable v in `occurrences` starts at offsets[v].
+    // Each range fills its part of the slice from counts[range][v], turned into an offset in the slice.
+    size_t variable_range_num = parallel_range_num(thread_num, var_num, 1 << 12);
+    vector<size_t> offsets(var_num + 1, 0);
+    auto count_slices = [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            uint32_t slice_size = 0;
+            for (auto &count : counts)
+            {
+                auto range_size = count[v];
+                count[v] = slice_size;
+                slice_size += range_size;
+            }
+            offsets[v + 1] = slice_size;
+        }
+    };
+    parallel_for(variable_range_num, var_num, count_slices);
+    for (size_t v = 0; v < var_num; v++)
+        offsets[v + 1] += offsets[v];
+
+    // Pass 4: fill the slices, in the order of the clauses, then build the occurrence sets from them.
+    vector<ClauseID> occurrences(offsets[var_num]);
+    auto fill_slices = [&](size_t range, size_t begin, size_t end)
+    {
+        auto &cursor = counts[range];
+        ClauseID clause_id = first_id[range];
+        for (size_t c = begin; c < end; c++)
+        {
+            if (!valid[c])
+                continue;
+            for (auto &literal : input[c])
+            {
+                auto var_id = find_id(literal.second);
+                occurrences[offsets[var_id] + cursor[var_id]++] = clause_id;
+            }
+            clause_id++;
+        }
+    };
+    parallel_for(range_num, input.size(), fill_slices);
+    auto build_occurrences = [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t v = begin; v < end; v++)
+        {
+            auto &variable_clauses = get_variable(v).clauses;
+            variable_clauses.reserve(variable_clauses.size() + offsets[v + 1] - offsets[v]);
+            variable_clauses.insert(occurrences.begin() + offsets[v], occurrences.begin() + offsets[v + 1]);
+        }
+    };
+    parallel_for(variable_range_num, var_num, build_occurrences);
+
+    clauses.reserve(first_id.back() + valid_num.back());
+    for (auto &range_clauses : built)
+        for (auto &clause : range_clauses)
+        {
+            // All the literals are false at level 0 (or the clause is empty).
+            if (clause.is_conflict())
+                inconsistent = true;
+            add_clause(std::move(clause));
+        }
+}
+
+template <typename Policies>
+optional<bool> BasicSATSolver<Policies>::solve(const vector<pair<bool, size_t>> &assumptions)
+{
+    failed_assumptions.clear();
+    if (inconsistent)
         return false;
-    while (!variables_by_value[UNASSIGNED].empty())
+
+    // The previous call may have left a full assignment.
+    backtrack(0);
+
+    vector<pair<VariableID, bool>> internal_assumptions;
+    for (auto &assumption : assumptions)
+        internal_assumptions.push_back({get_or_create_variable(assumption.second), assumption.first});
+
+    if (propagate().has_value())
+    {
+        inconsistent = true;
+        return false;
+    }
+    bool restart_pending = false;
+    while (true)
     {
+        if (terminate_callback && terminate_callback())
+            return nullopt;
+
         if (unipropagate_queue.empty())
         {
-            auto decision = decision_policy();
-            claim(!assign(decision.first, decision.second).has_value());
-            implication_graph.push_decision_node(decision.first);
+            if (restart_pending)
+            {
+                restart_pending = false;
+                statistic.restartNum++;
+                backtrack(0);
+                log_stream << "[Restart] " << statistic.restartNum << endl;
+                // The additional propagators may derive more at level 0 than they did at the deeper levels.
+                if (propagate().has_value())
+                {
+                    inconsistent = true;
+                    return false;
+                }
+                continue;
+            }
+
+            if (checkpoint_callback && std::chrono::steady_clock::now() >= next_checkpoint)
+            {
+                checkpoint_callback(save_snapshot());
+                next_checkpoint = std::chrono::steady_clock::now() + checkpoint_interval;
+            }
+
+            // Assumptions are decided before anything else. Those already true are skipped.
+            optional<pair<VariableID, bool>> decision;
+            for (auto &assumption : internal_assumptions)
+            {
+                auto value = get_variable(assumption.first).value;
+                if (value == UNASSIGNED)
+                {
+                    decision = assumption;
+                    break;
+                }
+                else if (value != bool2variableValue(assumption.second))
+                {
+                    analyze_final(assumption.first);
+                    return false;
+                }
+            }
+            if (!decision.has_value())
+            {
+                if (variables_by_value[UNASSIGNED].empty())
+                    break;
+                decision = decide();
+            }
+            claim(!assign(decision->first, decision->second).has_value());
+            implication_graph.push_decision_node(decision->first);
         }
 
-        auto unipropagate_result = unipropagate();
+        auto unipropagate_result = propagate();
         if (unipropagate_result.has_value())
         {
-            auto conflict_result = implication_graph.confilict_analysis(unipropagate_result.value());
-            claim(!conflict_result.empty());
             if (implication_graph.get_decision_level() == 0)
+            {
+                inconsistent = true;
                 return false;
+            }
+            auto conflict_result = implication_graph.confilict_analysis(unipropagate_result.value());
+            claim(!conflict_result.empty());
             log_stream << "[Conflict analysis] ";
             for (auto pos : conflict_result)
                 log_stream << VarID2originalName[implication_graph[pos].variableID] << ", ";
             log_stream << endl;
             auto learnt_clause_id = clauses.size();
             Clause learnt_clause(*this, learnt_clause_id);
+            unordered_set<size_t> learnt_clause_levels;
             for (auto pos : conflict_result)
             {
                 auto var_id = implication_graph[pos].variableID;
                 claim(learnt_clause.add_literal(var_id, !get_variable(var_id).value));
+                learnt_clause_levels.insert(implication_graph[pos].decision_level);
+                decision_policy.on_conflict_variable(var_id);
             }
+            decision_policy.on_conflict();
             learnt_clause.update();
             for (auto literal : learnt_clause.get_literals())
             {
                 get_variable(literal.first).add_clause(learnt_clause_id);
             }
 
+            if (learn_callback && learnt_clause.get_literals().size() <= learn_max_length)
+            {
+                vector<pair<bool, size_t>> exported;
+                for (auto &varID_literal : learnt_clause.get_literals())
+                    exported.push_back({varID_literal.second.get_literal_type(), VarID2originalName[varID_literal.first]});
+                learn_callback(exported);
+            }
+
             add_clause(std::move(learnt_clause));
-            unipropagate_queue.push_back(learnt_clause_id);
             /**
              * @brief Backjump
              *
@@ -291,18 +681,23 @@ bool SATSolver::solve()
             else
                 backjump_decision_level = implication_graph[std::max_element(conflict_result.cbegin() + 1, conflict_result.cend()).operator*()].decision_level;
 
-            while (implication_graph.get_decision_level() > backjump_decision_level)
-            {
-                reset(implication_graph.back().variableID);
-                implication_graph.pop();
-            }
+            backtrack(backjump_decision_level);
+            // The new learnt clause is registered after the reduction, which must not remove it before it is propagated.
+            if (reduction_policy.on_conflict())
+                reduce_learnt_clauses();
+            reduction_policy.on_learnt(learnt_clause_id, conflict_result.size(), learnt_clause_levels.size());
+            unipropagate_queue.push_back(learnt_clause_id);
+            if (restart_policy.on_conflict())
+                restart_pending = true;
 
             log_stream << "[Backjump] "
                        << "L" << backjump_decision_level << " "
                        << "stack depth: " << implication_graph.size() << endl;
-            // }
         }
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+#define SAT_INSTANTIATE(Decision, Restart, Reduction, Phase) template class BasicSATSolver<SolverPolicies<Decision, Restart, Reduction, Phase>>;
+SAT_REGISTERED_POLICIES(SAT_INSTANTIATE)
@@ -10,7 +10,9 @@
 #include <iostream>
 #include <algorithm>
 #include <cstdlib>
+#include <functional>
 #include "utility.hpp"
+#include "policies.hpp"
 
 #ifndef SAT_SOLVER
 #define SAT_SOLVER
@@ -22,9 +24,12 @@ using namespace std;
  *
  * TODO Modify accessibility
  *
+ * @tparam Policies a `SolverPolicies` combination (see policies.hpp). The member functions defined in sat_solver.cpp and xor_propagator.cpp
+ * are instantiated there for the combinations in policy_registry.hpp.
  */
 
-class SATSolver
+template <typename Policies>
+class BasicSATSolver
 {
 public:
     using ClauseID = size_t;
@@ -41,7 +46,7 @@ public:
     {
     private:
         const VariableID variableID;
-        SATSolver *sat_solver;
+        BasicSATSolver *sat_solver;
 
         // true if the literal is `variable`,
         // false if the literal is `Not(variable)`
@@ -53,7 +58,7 @@ public:
         VariableID get_variable_id() const;
         Variable &get_variable() const;
 
-        Literal(SATSolver *sat_solver, VariableID variable, bool literal_type);
+        Literal(BasicSATSolver *sat_solver, VariableID variable, bool literal_type);
         Literal() : variableID(0), sat_solver(nullptr), literal_type(false)
         {
             throw logic_error("The default constructor for SATSolver::Literal should never be called");
@@ -65,7 +70,7 @@ public:
     class Clause
     {
     private:
-        SATSolver &sat_solver;
+        BasicSATSolver &sat_solver;
         ClauseID clauseID;
 
         // NOTE A variable should not appear more than once in a single clause
@@ -78,7 +83,7 @@ public:
         unordered_map<VariableID, Literal> literals;
 
     public:
-        Clause(SATSolver &sat_solver, ClauseID clauseID);
+        Clause(BasicSATSolver &sat_solver, ClauseID clauseID);
 
         bool add_literal(VariableID variableID, bool literal_type);
 
@@ -108,6 +113,17 @@ public:
 
         bool is_conflict();
 
+        /**
+         * @brief Drop all the literals, once the clause is removed from the solver.
+         *
+         */
+        void clear()
+        {
+            for (auto &literals_with_value : literals_by_value)
+                literals_with_value.clear();
+            literals.clear();
+        }
+
         VariableValue value()
         {
             if (!literals_by_value[TRUE].empty())
@@ -150,22 +166,22 @@ public:
     class Variable
     {
     public:
-        SATSolver &sat_solver;
+        BasicSATSolver &sat_solver;
         VariableID variableID;
 
         // The clauses containing this variable.
         unordered_set<ClauseID> clauses;
 
         VariableValue value;
-        Variable(SATSolver &sat_solver, VariableID variableID);
+        Variable(BasicSATSolver &sat_solver, VariableID variableID);
 
-        pair<unordered_set<SATSolver::VariableID>::iterator, bool> add_clause(ClauseID);
+        pair<typename unordered_set<ClauseID>::iterator, bool> add_clause(ClauseID);
     };
 
     class ImplicationGraph
     {
     private:
-        SATSolver &sat_solver;
+        BasicSATSolver &sat_solver;
 
     public:
         struct Node
@@ -203,7 +219,7 @@ public:
         unordered_map<VariableID, Index> var2pos;
 
     public:
-        ImplicationGraph(SATSolver &sat_solver) : sat_solver(sat_solver) {}
+        ImplicationGraph(BasicSATSolver &sat_solver) : sat_solver(sat_solver) {}
 
         const auto &operator[](Index index) const
         {
@@ -261,27 +277,171 @@ public:
          * @return vector<Index>
          */
         vector<Index> confilict_analysis(ClauseID conflict_clause);
+
+        /**
+         * @brief The decision nodes from which the assignment of `variableID` is derived (including itself if it is a decision).
+         *
+         * @param variableID
+         * @return vector<VariableID>
+         */
+        vector<VariableID> decision_ancestors(VariableID variableID);
+
+        /**
+         * @brief The clauses from which the current assignments derive.
+         *
+         */
+        unordered_set<ClauseID> reasons() const
+        {
+            unordered_set<ClauseID> result;
+            for (auto &node : stack)
+                if (node.derive_from.has_value())
+                    result.insert(node.derive_from.value());
+            return result;
+        }
     };
 
     /**
-     * @brief TODO Dummie dicision policy for now.
+     * @brief Propagation over XOR constraints recovered from the clauses, by Gauss-Jordan elimination.
+     *
+     * Rows are bit-packed over the XOR variables (the columns). At each propagation fixpoint, the rows are eliminated on the unassigned columns:
+     * a row left without unassigned columns and with odd parity is a conflict, a row left with 1 unassigned column implies its value.
+     * The reason is materialized as a clause over the variables of that row, so that conflict analysis sees it like any other clause.
      *
      */
-    class DecisionPolicy
+    class XorPropagator
     {
     private:
-        SATSolver &sat_solver;
+        BasicSATSolver &sat_solver;
+
+        vector<VariableID> columns;
+        size_t word_num = 0;
+        // rows[r * word_num + w] is the w-th word of row r. The rows are kept reduced from one propagation to the next:
+        // row operations do not change the constraints, so backtracking does not undo them.
+        vector<uint64_t> rows;
+        vector<bool> parities;
+        // The pivot column of each row (`no_pivot` if none): an unassigned column which appears in no other row.
+        static constexpr size_t no_pivot = static_cast<size_t>(-1);
+        vector<size_t> pivot_columns;
+
+        // Assignment of the columns at the last elimination, which found nothing to propagate.
+        vector<uint64_t> last_unassigned_mask, last_true_mask;
 
     public:
-        DecisionPolicy(SATSolver &sat_solver) : sat_solver(sat_solver) {}
+        XorPropagator(BasicSATSolver &sat_solver) : sat_solver(sat_solver) {}
+
+        /**
+         * @brief Recover the XOR constraints of at most `max_size` variables encoded by the clauses.
+         *
+         * @return size_t the number of XOR constraints
+         */
+        size_t detect(size_t max_size);
 
-        pair<VariableID, bool> operator()() const
+        bool empty() const
         {
-            sat_solver.statistic.decisionNum++;
-            return {sat_solver.variables_by_value[UNASSIGNED].begin().operator*(), true};
+            return parities.empty();
+        }
 
-            // TODO
+        size_t variable_num() const
+        {
+            return columns.size();
         }
+
+        /**
+         * @brief Add the reason clauses of the implied assignments to the unipropagation queue.
+         *
+         * @return optional<ClauseID> the conflict clause
+         */
+        optional<ClauseID> propagate();
+    };
+
+    /**
+     * @brief Propagation over at-most-k constraints (at-least-k constraints are normalized to at-most-k over the negated literals).
+     *
+     * Each constraint counts its true literals, updated on every assignment. A constraint which reaches its bound implies its unassigned literals false;
+     * one which exceeds it is a conflict. Explanations are only built then, as clauses over the negations of the true literals,
+     * so that conflict analysis sees them like any other clause. They are handed to the reduction policy like learnt clauses.
+     *
+     */
+    class CardinalityPropagator
+    {
+    public:
+        struct Constraint
+        {
+            // (variable, literal type), counted with multiplicity
+            vector<pair<VariableID, bool>> literals;
+            size_t bound;
+            size_t true_num = 0;
+            bool queued = false;
+        };
+
+    private:
+        BasicSATSolver &sat_solver;
+
+        vector<Constraint> constraints;
+        // occurrences[v] are the (constraint, literal type) of variable v
+        vector<vector<pair<size_t, bool>>> occurrences;
+        // The constraints which reached their bound since they were last propagated
+        vector<size_t> pending;
+        // Order of the assignments, to pick the latest true literals for a conflict
+        vector<size_t> assigned_at;
+        size_t clock = 0;
+
+    public:
+        CardinalityPropagator(BasicSATSolver &sat_solver) : sat_solver(sat_solver) {}
+
+        /**
+         * @brief Add the constraint: at most `bound` of `literals` are true.
+         *
+         */
+        void add(const vector<pair<VariableID, bool>> &literals, size_t bound);
+
+        bool empty() const
+        {
+            return constraints.empty();
+        }
+
+        const vector<Constraint> &get_constraints() const
+        {
+            return constraints;
+        }
+
+        const vector<pair<size_t, bool>> &get_occurrences(VariableID variableID) const
+        {
+            static const vector<pair<size_t, bool>> none;
+            return variableID < occurrences.size() ? occurrences[variableID] : none;
+        }
+
+        void on_assign(VariableID variableID, bool b_variableValue)
+        {
+            if (variableID >= occurrences.size())
+                return;
+            assigned_at[variableID] = clock++;
+            for (auto &constraint_type : occurrences[variableID])
+            {
+                auto &constraint = constraints[constraint_type.first];
+                if (constraint_type.second == b_variableValue && ++constraint.true_num >= constraint.bound && !constraint.queued)
+                {
+                    constraint.queued = true;
+                    pending.push_back(constraint_type.first);
+                }
+            }
+        }
+
+        void on_unassign(VariableID variableID, bool b_variableValue)
+        {
+            if (variableID >= occurrences.size())
+                return;
+            for (auto &constraint_type : occurrences[variableID])
+                if (constraint_type.second == b_variableValue)
+                    constraints[constraint_type.first].true_num--;
+        }
+
+        /**
+         * @brief Add the explanation clauses of the implied assignments to the unipropagation queue.
+         *
+         * @return optional<ClauseID> the conflict clause
+         */
+        optional<ClauseID> propagate();
     };
 
 public:
@@ -290,14 +450,30 @@ public:
         std::chrono::nanoseconds time_cost;
         size_t decisionNum = 0;
         size_t backjumpNum = 0;
+        size_t restartNum = 0;
+        size_t removedClauseNum = 0;
+        size_t xorNum = 0;
+        size_t cardinalityNum = 0;
+        std::chrono::nanoseconds xor_elimination_time{0};
     };
 
 private:
-    friend class DecisionPolicy;
+    // Drives the private kernels in isolation (tests/microbench.cpp)
+    friend class MicroBenchmark;
+    // Work on the clauses and the trail directly (enumeration.hpp, lookahead.hpp, backbone.hpp)
+    template <typename Solver>
+    friend class ModelEnumerator;
+    template <typename Solver>
+    friend class ModelCounter;
+    template <typename Solver>
+    friend class LookaheadSolver;
+    template <typename Solver>
+    friend class BackboneFinder;
 
     ostream &log_stream;
 
     vector<size_t> VarID2originalName;
+    unordered_map<size_t, VariableID> OriginalName2varID;
     vector<Clause> clauses;
 
     array<unordered_set<VariableID>, 3> variables_by_value;
@@ -305,11 +481,31 @@ private:
 
     deque<ClauseID> unipropagate_queue;
     ImplicationGraph implication_graph;
-    DecisionPolicy decision_policy;
+    XorPropagator xor_propagator;
+    CardinalityPropagator cardinality_propagator;
     Statistic statistic;
 
+    typename Policies::DecisionPolicy decision_policy;
+    typename Policies::PhasePolicy phase_policy;
+    typename Policies::RestartPolicy restart_policy;
+    typename Policies::ReductionPolicy reduction_policy;
+
+    // Set once a conflict is found at decision level 0. Only learnt clauses are removed, so the formula stays UNSAT.
+    bool inconsistent = false;
+
+    // Original names of the assumption variables responsible for the last UNSAT answer under assumptions.
+    unordered_set<size_t> failed_assumptions;
+
+    function<bool()> terminate_callback;
+    function<void(const vector<pair<bool, size_t>> &)> learn_callback;
+    size_t learn_max_length = 0;
+
+    function<void(string &&)> checkpoint_callback;
+    std::chrono::milliseconds checkpoint_interval{0};
+    std::chrono::steady_clock::time_point next_checkpoint;
+
 public:
-    SATSolver(ostream &log_stream = cerr) : log_stream(log_stream), implication_graph(*this), decision_policy(*this) {}
+    BasicSATSolver(ostream &log_stream = cerr) : log_stream(log_stream), implication_graph(*this), xor_propagator(*this), cardinality_propagator(*this) {}
 
     /**
      * @brief Input specification: Container<Container<pair<bool, size_t>>>
@@ -317,6 +513,8 @@ public:
      * TODO Preprocess: currrently, we assert a variable appears in a clause at most once.
      *
      * NOTE Since it's a template, I put the definition in the header.
+     * NOTE `initiate` may be called again after `solve` to add more clauses incrementally.
+     * The solver then backtracks to decision level 0 first.
      *
      * @tparam Iterator
      * @param clause_first
@@ -325,7 +523,7 @@ public:
     template <typename Iterator>
     void initiate(Iterator clause_first, Iterator clause_last)
     {
-        unordered_map<size_t, VariableID> OriginalName2varID;
+        backtrack(0);
         Iterator clause_iter{clause_first};
         while (clause_iter != clause_last)
         {
@@ -337,21 +535,7 @@ public:
 
             while (liter_iter != clause_iter->cend())
             {
-                auto res = OriginalName2varID.find(liter_iter->second);
-                VariableID cur_var_id;
-                if (res == OriginalName2varID.end())
-                // New variable
-                {
-                    cur_var_id = VarID2originalName.size();
-                    OriginalName2varID[liter_iter->second] = cur_var_id;
-                    VarID2originalName.push_back(liter_iter->second);
-                    variables.push_back(Variable(*this, cur_var_id));
-                    variables_by_value[UNASSIGNED].insert(cur_var_id);
-                }
-                else
-                {
-                    cur_var_id = res->second;
-                }
+                VariableID cur_var_id = get_or_create_variable(liter_iter->second);
                 get_variable(cur_var_id).add_clause(cur_clause_id);
                 if (!cur_clause.add_literal(cur_var_id, liter_iter->first))
                 {
@@ -361,7 +545,12 @@ public:
                 liter_iter++;
             }
             if (valid_clause)
+            {
+                // All the literals are false at level 0 (or the clause is empty).
+                if (cur_clause.is_conflict())
+                    inconsistent = true;
                 add_clause(std::move(cur_clause));
+            }
             else
             {
                 for (auto &variable : variables)
@@ -370,16 +559,88 @@ public:
             clause_iter++;
         }
     }
+
+    /**
+     * @brief `initiate` on up to `thread_num` threads, with the same variables, clause IDs and unipropagation queue.
+     *
+     * The clauses are split into ranges, each checked and built by its own thread; the variables are created in order of first appearance
+     * between the passes. The occurrence lists are laid out by a counting sort: the occurrences of each variable are counted per range,
+     * the prefix sums give each (variable, range) its slice of a flat array, which the ranges fill in parallel, and each variable's set
+     * is then built from its slice.
+     *
+     * @param input a CNF, as the input of `initiate`
+     */
+    void initiate_parallel(const vector<vector<pair<bool, size_t>>> &input, size_t thread_num);
+
 private:
     void add_clause(Clause &&clause)
     {
         if (clause.to_decide_num() == 1)
             unipropagate_queue.push_back(clause.get_clause_id());
-        clauses.push_back(clause);
+        clauses.push_back(std::move(clause));
     }
 
     void update_clauses();
 
+    VariableID get_or_create_variable(size_t original_name)
+    {
+        auto res = OriginalName2varID.find(original_name);
+        if (res != OriginalName2varID.end())
+            return res->second;
+        // New variable
+        VariableID var_id = VarID2originalName.size();
+        OriginalName2varID[original_name] = var_id;
+        VarID2originalName.push_back(original_name);
+        variables.push_back(Variable(*this, var_id));
+        variables_by_value[UNASSIGNED].insert(var_id);
+        decision_policy.add_variable();
+        phase_policy.add_variable();
+        return var_id;
+    }
+
+    /**
+     * @brief The next decision, by the decision and phase policies.
+     *
+     */
+    pair<VariableID, bool> decide()
+    {
+        statistic.decisionNum++;
+        auto variableID = decision_policy.pick(variables_by_value[UNASSIGNED]);
+        return {variableID, phase_policy.phase(variableID)};
+    }
+
+    /**
+     * @brief Detach a learnt clause from its variables. Its ID stays reserved.
+     *
+     * NOTE The clause should be neither a reason of the current assignment nor in the unipropagation queue.
+     *
+     * @param clauseID
+     */
+    void remove_clause(ClauseID clauseID);
+
+    /**
+     * @brief Remove the learnt clauses chosen by the reduction policy.
+     *
+     */
+    void reduce_learnt_clauses();
+
+    /**
+     * @brief Undo all the assignments above `decision_level`.
+     *
+     * NOTE Nothing happens if the solver is not above `decision_level`.
+     * Otherwise the unipropagation queue is cleared: every clause that is unit at `decision_level` has been propagated before a deeper decision was made.
+     *
+     * @param decision_level
+     */
+    void backtrack(size_t decision_level);
+
+    /**
+     * @brief Collect the assumptions that imply the (false) assumption on `variableID` into `failed_assumptions`.
+     *
+     * @param variableID
+     */
+    void analyze_final(VariableID variableID);
+
     /**
      * @brief `assign` should be the way and the only way to assign a non-unassigned value to a variable.
      *
@@ -408,14 +669,114 @@ private:
      */
     optional<ClauseID> unipropagate();
 
+    /**
+     * @brief Unipropagation and the additional propagators, until none of them derives anything.
+     *
+     * @return optional<ClauseID> the conflict clause
+     */
+    optional<ClauseID> propagate();
+
+    /**
+     * @brief Add a clause implied by the formula, e.g. the reason of an assignment made by an additional propagator.
+     * It is added to the unipropagation queue if it is unit under the current assignment.
+     *
+     * @param literals
+     * @return ClauseID
+     */
+    ClauseID add_implied_clause(const vector<pair<VariableID, bool>> &literals);
+
 public:
     /**
      * @brief
      *
      * @return true SAT
      * @return false UNSAT
+     * @return nullopt interrupted by the terminate callback
+     */
+    optional<bool> solve()
+    {
+        return solve({});
+    }
+
+    /**
+     * @brief Solve under `assumptions`, which only hold for this call.
+     *
+     * @param assumptions literals in the same form as the input of `initiate`
+     * @return true SAT
+     * @return false UNSAT (under the assumptions, see `is_failed`)
+     * @return nullopt interrupted by the terminate callback
+     */
+    optional<bool> solve(const vector<pair<bool, size_t>> &assumptions);
+
+    /**
+     * @brief The callback is polled during the search. `solve` gives up once it returns true.
+     *
+     */
+    void set_terminate(function<bool()> callback)
+    {
+        terminate_callback = std::move(callback);
+    }
+
+    /**
+     * @brief The callback is fed every learnt clause with at most `max_length` literals.
+     *
      */
-    bool solve();
+    void set_learn(size_t max_length, function<void(const vector<pair<bool, size_t>> &)> callback)
+    {
+        learn_max_length = max_length;
+        learn_callback = std::move(callback);
+    }
+
+    /**
+     * @brief During `solve`, the callback is fed a snapshot (see `save_snapshot`) every `interval`, at a decision point.
+     *
+     */
+    void set_checkpoint(std::chrono::milliseconds interval, function<void(string &&)> callback)
+    {
+        checkpoint_interval = interval;
+        checkpoint_callback = std::move(callback);
+        next_checkpoint = std::chrono::steady_clock::now() + interval;
+    }
+
+    /**
+     * @brief Serialize the search state: the variables, the clauses (learnt ones included, with their IDs),
+     * the level-0 assignments with their reasons, the statistics and the state of the policies.
+     * The saved phases include the current assignments above level 0, as if the solver backtracked.
+     *
+     * NOTE The XOR and cardinality constraints are not included: add them again after `load_snapshot`.
+     *
+     */
+    string save_snapshot();
+
+    /**
+     * @brief Restore the state saved by `save_snapshot`, in a solver without any clause yet.
+     * The state of the policies is only restored if the policies are the same; otherwise the learnt clauses are kept as irredundant ones.
+     *
+     * Throws `invalid_argument` if the snapshot is malformed, before anything is restored.
+     *
+     */
+    void load_snapshot(const string &snapshot);
+
+    /**
+     * @brief Whether the assumption on `original_name` was used to prove the last UNSAT answer.
+     *
+     */
+    bool is_failed(size_t original_name) const
+    {
+        return failed_assumptions.count(original_name) != 0;
+    }
+
+    /**
+     * @brief Value of the variable in the last model. nullopt if the variable is unknown to the solver.
+     *
+     */
+    optional<bool> get_value(size_t original_name)
+    {
+        auto res = OriginalName2varID.find(original_name);
+        if (res == OriginalName2varID.end())
+            return nullopt;
+        return variableValue2optional(get_variable(res->second).value);
+    }
 
     unordered_map<size_t, bool> get_result()
     {
@@ -428,10 +789,60 @@ public:
         return result;
     }
 
+    /**
+     * @brief Recover XOR constraints from the clauses, and propagate them by Gauss-Jordan elimination during `solve`.
+     *
+     * @param max_size the largest XOR constraint to look for
+     * @return size_t the number of XOR constraints found
+     */
+    size_t detect_xors(size_t max_size = 6)
+    {
+        statistic.xorNum = xor_propagator.detect(max_size);
+        return statistic.xorNum;
+    }
+
+    /**
+     * @brief Add the constraint: at most `bound` of `literals` are true. Literals are in the same form as the input of `initiate`,
+     * and are counted with multiplicity.
+     *
+     * NOTE Like `initiate`, it may be called again after `solve`.
+     *
+     */
+    void add_at_most(const vector<pair<bool, size_t>> &literals, size_t bound)
+    {
+        backtrack(0);
+        if (bound >= literals.size())
+            return;
+        vector<pair<VariableID, bool>> internal_literals;
+        for (auto &literal : literals)
+            internal_literals.push_back({get_or_create_variable(literal.second), literal.first});
+        cardinality_propagator.add(internal_literals, bound);
+        statistic.cardinalityNum++;
+    }
+
+    /**
+     * @brief Add the constraint: at least `bound` of `literals` are true.
+     *
+     */
+    void add_at_least(const vector<pair<bool, size_t>> &literals, size_t bound)
+    {
+        if (bound > literals.size())
+        {
+            inconsistent = true;
+            return;
+        }
+        vector<pair<bool, size_t>> negated;
+        for (auto &literal : literals)
+            negated.push_back({!literal.first, literal.second});
+        add_at_most(negated, literals.size() - bound);
+    }
+
     auto get_statistics()
     {
         return statistic;
     }
 };
 
+using SATSolver = BasicSATSolver<DefaultPolicies>;
+
 #endif
\ No newline at end of file
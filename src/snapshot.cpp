@@ -0,0 +1,342 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include "snapshot.hpp"
+#include "sat_solver.hpp"
+#include "policy_registry.hpp"
+
+namespace
+{
+    constexpr char magic[8] = {'S', 'A', 'T', 'S', 'N', 'A', 'P', 'S'};
+    constexpr uint32_t version = 1;
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint64_t formula_key;
+        uint64_t size;
+        uint64_t checksum;
+    };
+
+    uint64_t checksum(const string &data)
+    {
+        uint64_t result = data.size();
+        size_t pos = 0;
+        for (; pos + 8 <= data.size(); pos += 8)
+        {
+            uint64_t word;
+            memcpy(&word, data.data() + pos, 8);
+            result = hash_combine(result, word);
+        }
+        for (; pos < data.size(); pos++)
+            result = hash_combine(result, static_cast<uint8_t>(data[pos]));
+        return result;
+    }
+}
+
+Checkpointer::Checkpointer(string path, uint64_t formula_key) : path(std::move(path)), formula_key(formula_key), writer(&Checkpointer::run, this) {}
+
+Checkpointer::~Checkpointer()
+{
+    {
+        lock_guard<mutex> guard(pending_mutex);
+        stopping = true;
+    }
+    pending_cv.notify_one();
+    writer.join();
+}
+
+void Checkpointer::submit(string &&snapshot)
+{
+    {
+        lock_guard<mutex> guard(pending_mutex);
+        pending = std::move(snapshot);
+    }
+    pending_cv.notify_one();
+}
+
+size_t Checkpointer::get_written_num()
+{
+    lock_guard<mutex> guard(pending_mutex);
+    return written_num;
+}
+
+void Checkpointer::run()
+{
+    while (true)
+    {
+        string snapshot;
+        {
+            unique_lock<mutex> lock(pending_mutex);
+            pending_cv.wait(lock, [this]()
+                            { return pending.has_value() || stopping; });
+            if (!pending.has_value())
+                return;
+            snapshot = std::move(pending.value());
+            pending.reset();
+        }
+        bool written = write_file(snapshot);
+        lock_guard<mutex> guard(pending_mutex);
+        written_num += written;
+    }
+}
+
+bool Checkpointer::write_file(const string &snapshot)
+{
+    FileHeader header;
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.formula_key = formula_key;
+    header.size = snapshot.size();
+    header.checksum = checksum(snapshot);
+
+    string temp_path = path + ".tmp";
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        cerr << "[Checkpoint] failed to open " << temp_path << endl;
+        return false;
+    }
+    auto write_all = [fd](const char *data, size_t size)
+    {
+        while (size != 0)
+        {
+            auto written = ::write(fd, data, size);
+            if (written <= 0)
+                return false;
+            data += written;
+            size -= written;
+        }
+        return true;
+    };
+    // The data is on disk before the rename makes it the snapshot.
+    bool ok = write_all(reinterpret_cast<const char *>(&header), sizeof(header)) && write_all(snapshot.data(), snapshot.size()) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        cerr << "[Checkpoint] failed to write " << path << endl;
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+optional<string> Checkpointer::read(const string &path, uint64_t formula_key)
+{
+    ifstream input(path, ios::binary);
+    if (!input)
+        return nullopt;
+    FileHeader header;
+    if (!input.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version)
+    {
+        cerr << "[Checkpoint] " << path << " is not a compatible snapshot" << endl;
+        return nullopt;
+    }
+    if (header.formula_key != formula_key)
+    {
+        cerr << "[Checkpoint] " << path << " was written for another formula" << endl;
+        return nullopt;
+    }
+    stringstream buffer;
+    buffer << input.rdbuf();
+    string snapshot = buffer.str();
+    if (snapshot.size() != header.size || checksum(snapshot) != header.checksum)
+    {
+        cerr << "[Checkpoint] " << path << " is corrupt" << endl;
+        return nullopt;
+    }
+    return snapshot;
+}
+
+template <typename Policies>
+string BasicSATSolver<Policies>::save_snapshot()
+{
+    SnapshotWriter out;
+    out.write(policies_to_string<Policies>());
+    out.write<uint8_t>(inconsistent);
+
+    out.write(vector<uint64_t>(VarID2originalName.begin(), VarID2originalName.end()));
+    // Removed clauses are saved empty, so that the clause IDs known to the policies stay valid.
+    out.write<uint64_t>(clauses.size());
+    for (auto &clause : clauses)
+    {
+        out.write<uint32_t>(clause.get_literals().size());
+        for (auto &varID_literal : clause.get_literals())
+            out.write<uint64_t>(2 * varID_literal.first + varID_literal.second.get_literal_type());
+    }
+
+    // (variable, value, reason) of the level-0 assignments, in the order of the trail
+    vector<uint64_t> units;
+    auto phases = phase_policy;
+    for (size_t pos = 0; pos < implication_graph.size(); pos++)
+    {
+        auto &node = implication_graph[pos];
+        bool value = get_variable(node.variableID).value == TRUE;
+        if (node.decision_level != 0)
+            phases.on_unassign(node.variableID, value);
+        else
+            units.insert(units.end(), {node.variableID, value, node.derive_from.value()});
+    }
+    out.write(units);
+
+    out.write<int64_t>(statistic.time_cost.count());
+    out.write<uint64_t>(statistic.decisionNum);
+    out.write<uint64_t>(statistic.backjumpNum);
+    out.write<uint64_t>(statistic.restartNum);
+    out.write<uint64_t>(statistic.removedClauseNum);
+    out.write<uint64_t>(statistic.xorNum);
+    out.write<uint64_t>(statistic.cardinalityNum);
+    out.write<int64_t>(statistic.xor_elimination_time.count());
+
+    auto save_policy = [&](const auto &policy)
+    {
+        SnapshotWriter policy_out;
+        policy.save(policy_out);
+        out.write(policy_out.data());
+    };
+    save_policy(decision_policy);
+    save_policy(phases);
+    save_policy(restart_policy);
+    save_policy(reduction_policy);
+    return std::move(out.data());
+}
+
+template <typename Policies>
+void BasicSATSolver<Policies>::load_snapshot(const string &snapshot)
+{
+    claim(variables.empty() && clauses.empty());
+    SnapshotReader in(snapshot);
+    auto policies = in.read_string();
+    bool loaded_inconsistent = in.read<uint8_t>() != 0;
+
+    vector<uint64_t> names;
+    in.read(names);
+    if (unordered_set<uint64_t>(names.begin(), names.end()).size() != names.size())
+        throw invalid_argument("duplicate variable in snapshot");
+
+    // The whole snapshot is checked before anything is restored.
+    auto clause_num = in.read<uint64_t>();
+    vector<vector<pair<VariableID, bool>>> clause_literals;
+    // last_clause[v] is the last clause in which v was seen, to reject repeated variables
+    vector<size_t> last_clause(names.size(), static_cast<size_t>(-1));
+    for (size_t id = 0; id < clause_num; id++)
+    {
+        auto size = in.read<uint32_t>();
+        vector<pair<VariableID, bool>> literals;
+        for (size_t i = 0; i < size; i++)
+        {
+            auto code = in.read<uint64_t>();
+            VariableID var_id = code / 2;
+            if (var_id >= names.size() || last_clause[var_id] == id)
+                throw invalid_argument("bad clause in snapshot");
+            last_clause[var_id] = id;
+            literals.push_back({var_id, code % 2 != 0});
+        }
+        clause_literals.push_back(std::move(literals));
+    }
+
+    vector<uint64_t> units;
+    in.read(units);
+    if (units.size() % 3 != 0)
+        throw invalid_argument("bad level-0 assignment in snapshot");
+    vector<bool> is_unit(names.size(), false);
+    for (size_t i = 0; i < units.size(); i += 3)
+    {
+        auto var_id = units[i], reason = units[i + 2];
+        auto in_reason = [&](const pair<VariableID, bool> &literal)
+        {
+            return literal.first == var_id;
+        };
+        if (var_id >= names.size() || is_unit[var_id] || units[i + 1] > 1 || reason >= clause_num ||
+            none_of(clause_literals[reason].begin(), clause_literals[reason].end(), in_reason))
+            throw invalid_argument("bad level-0 assignment in snapshot");
+        is_unit[var_id] = true;
+    }
+
+    Statistic loaded_statistic;
+    loaded_statistic.time_cost = std::chrono::nanoseconds(in.read<int64_t>());
+    loaded_statistic.decisionNum = in.read<uint64_t>();
+    loaded_statistic.backjumpNum = in.read<uint64_t>();
+    loaded_statistic.restartNum = in.read<uint64_t>();
+    loaded_statistic.removedClauseNum = in.read<uint64_t>();
+    loaded_statistic.xorNum = in.read<uint64_t>();
+    loaded_statistic.cardinalityNum = in.read<uint64_t>();
+    loaded_statistic.xor_elimination_time = std::chrono::nanoseconds(in.read<int64_t>());
+
+    array<string, 4> policy_states;
+    for (auto &state : policy_states)
+        state = in.read_string();
+    if (!in.at_end())
+        throw invalid_argument("trailing data in snapshot");
+
+    for (auto name : names)
+        get_or_create_variable(name);
+    for (size_t id = 0; id < clause_num; id++)
+    {
+        Clause clause(*this, id);
+        for (auto &literal : clause_literals[id])
+        {
+            claim(clause.add_literal(literal.first, literal.second));
+            get_variable(literal.first).add_clause(id);
+        }
+        clauses.push_back(std::move(clause));
+    }
+    for (size_t i = 0; i < units.size(); i += 3)
+    {
+        if (assign(units[i], units[i + 1] != 0).has_value())
+            loaded_inconsistent = true;
+        implication_graph.push_propagate(units[i], units[i + 2]);
+    }
+    // Propagated at the next `solve`, in case the snapshot was not taken at a fixpoint
+    for (auto &clause : clauses)
+    {
+        if (clause.get_literals().empty())
+            continue;
+        if (clause.is_conflict())
+            loaded_inconsistent = true;
+        else if (clause.to_decide_num() == 1)
+            unipropagate_queue.push_back(clause.get_clause_id());
+    }
+    inconsistent = loaded_inconsistent;
+    statistic = loaded_statistic;
+
+    // The cardinality constraints and the XOR constraints are added again by the caller.
+    statistic.xorNum = 0;
+    statistic.cardinalityNum = 0;
+
+    if (policies != policies_to_string<Policies>())
+    {
+        log_stream << "[Snapshot] written with the policies " << policies << ": their state is not restored" << endl;
+        return;
+    }
+    // Each policy is restored as a whole or not at all.
+    auto load_policy = [&](auto &policy, const string &state)
+    {
+        auto loaded = policy;
+        SnapshotReader policy_in(state);
+        loaded.load(policy_in);
+        if (!policy_in.at_end())
+            throw invalid_argument("trailing data in policy state");
+        policy = std::move(loaded);
+    };
+    try
+    {
+        load_policy(decision_policy, policy_states[0]);
+        load_policy(phase_policy, policy_states[1]);
+        load_policy(restart_policy, policy_states[2]);
+        load_policy(reduction_policy, policy_states[3]);
+    }
+    catch (const invalid_argument &error)
+    {
+        log_stream << "[Snapshot] policy state not restored: " << error.what() << endl;
+    }
+}
+
+#define SAT_INSTANTIATE(Decision, Restart, Reduction, Phase)                                            \
+    template string BasicSATSolver<SolverPolicies<Decision, Restart, Reduction, Phase>>::save_snapshot(); \
+    template void BasicSATSolver<SolverPolicies<Decision, Restart, Reduction, Phase>>::load_snapshot(const string &);
+SAT_REGISTERED_POLICIES(SAT_INSTANTIATE)
@@ -0,0 +1,161 @@
+#include <string>
+#include <vector>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+#ifndef SNAPSHOT
+#define SNAPSHOT
+
+using namespace std;
+
+/**
+ * @brief Appends values to a binary snapshot, in the native byte order: snapshots are meant to be resumed by the same build.
+ *
+ */
+class SnapshotWriter
+{
+    string buffer;
+
+public:
+    template <typename T>
+    void write(const T &value)
+    {
+        static_assert(is_trivially_copyable_v<T>);
+        buffer.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    void write(const vector<T> &values)
+    {
+        write<uint64_t>(values.size());
+        for (auto &value : values)
+            write<T>(value);
+    }
+
+    void write(const vector<bool> &values)
+    {
+        write<uint64_t>(values.size());
+        for (bool value : values)
+            write<uint8_t>(value);
+    }
+
+    void write(const string &value)
+    {
+        write<uint64_t>(value.size());
+        buffer += value;
+    }
+
+    string &data()
+    {
+        return buffer;
+    }
+};
+
+/**
+ * @brief Reads back what `SnapshotWriter` wrote. Throws `invalid_argument` past the end of the snapshot.
+ *
+ */
+class SnapshotReader
+{
+    const string &buffer;
+    size_t pos = 0;
+
+    void require(size_t size)
+    {
+        if (size > buffer.size() - pos)
+            throw invalid_argument("truncated snapshot");
+    }
+
+public:
+    SnapshotReader(const string &buffer) : buffer(buffer) {}
+
+    template <typename T>
+    T read()
+    {
+        static_assert(is_trivially_copyable_v<T>);
+        require(sizeof(T));
+        T value;
+        memcpy(&value, buffer.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    template <typename T>
+    void read(vector<T> &values)
+    {
+        auto size = read<uint64_t>();
+        // Each element takes at least 1 byte: a corrupt size fails here instead of exhausting the memory.
+        require(size);
+        values.clear();
+        values.reserve(size);
+        for (size_t i = 0; i < size; i++)
+        {
+            if constexpr (is_same_v<T, bool>)
+                values.push_back(read<uint8_t>() != 0);
+            else
+                values.push_back(read<T>());
+        }
+    }
+
+    string read_string()
+    {
+        auto size = read<uint64_t>();
+        require(size);
+        string value = buffer.substr(pos, size);
+        pos += size;
+        return value;
+    }
+
+    bool at_end() const
+    {
+        return pos == buffer.size();
+    }
+};
+
+/**
+ * @brief Writes snapshots to a file from a background thread, so that the search only pays for the serialization.
+ *
+ * A file is written next to `path` and renamed over it, so that `path` always holds a complete snapshot.
+ * If snapshots are submitted faster than they are written, only the latest one is kept.
+ * The file frames the snapshot with a key of the formula, so that it is not resumed on another formula, and a checksum.
+ *
+ */
+class Checkpointer
+{
+    string path;
+    uint64_t formula_key;
+
+    mutex pending_mutex;
+    condition_variable pending_cv;
+    optional<string> pending;
+    bool stopping = false;
+    size_t written_num = 0;
+    thread writer;
+
+    void run();
+    bool write_file(const string &snapshot);
+
+public:
+    Checkpointer(string path, uint64_t formula_key);
+    // Writes the last pending snapshot before returning.
+    ~Checkpointer();
+
+    void submit(string &&snapshot);
+
+    size_t get_written_num();
+
+    /**
+     * @brief The snapshot in the file at `path`.
+     *
+     * @return nullopt if there is no such file, or it is corrupt or written for another formula (reported on stderr)
+     */
+    static optional<string> read(const string &path, uint64_t formula_key);
+};
+
+#endif
@@ -0,0 +1,434 @@
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <deque>
+#include "symmetry.hpp"
+#include "utility.hpp"
+
+namespace
+{
+    using Vertex = uint32_t;
+
+    // Refinements allowed when looking for an automorphism that maps one vertex to another.
+    constexpr size_t branch_budget = 256;
+    // Work allowed for the whole search, in vertices and edges visited by refinements, colourings and automorphism checks
+    constexpr size_t total_budget = 100000000;
+    // Lex-leader constraints only consider this many variables moved by a generator.
+    constexpr size_t max_support = 256;
+
+    /**
+     * @brief An ordered partition of the vertices. The colour of a vertex is the position of its cell, once the vertices are listed cell by cell,
+     * so that colours only depend on the sizes and the order of the cells.
+     *
+     */
+    struct Coloring
+    {
+        vector<uint32_t> cell_of;
+        size_t cell_num = 0;
+    };
+
+    /**
+     * @brief Search generators of the automorphism group of a coloured graph by individualization and refinement.
+     *
+     * The first path individualizes the first vertex of the target cell at each level down to a discrete colouring.
+     * Going up the first path, the other vertices of each target cell are tried; a branch that reaches a discrete colouring of the same shape yields a candidate mapping, which is kept if it is an automorphism.
+     * Vertices already in the orbit of the first path vertex are skipped.
+     *
+     */
+    class AutomorphismSearch
+    {
+    private:
+        /**
+         * @brief A colouring being refined: the vertices listed cell by cell, so that a cell can be split in place.
+         *
+         */
+        struct Partition
+        {
+            vector<Vertex> elements;
+            vector<uint32_t> position;
+            vector<uint32_t> cell_of;
+            // cell_end[start] is the end of the cell at position `start`; only meaningful at the start of a cell
+            vector<uint32_t> cell_end;
+            size_t cell_num;
+        };
+
+        const vector<vector<Vertex>> &adjacency;
+        size_t vertex_num;
+
+        vector<Coloring> first_path;
+        vector<Vertex> first_path_choice;
+        // first_leaf[c] is the vertex of colour c at the end of the first path
+        vector<Vertex> first_leaf;
+
+        vector<Vertex> orbit_parent;
+        size_t work = 0;
+
+        // Scratch space of `refine`, left zeroed
+        vector<uint32_t> neighbor_count;
+        vector<char> queued;
+
+        vector<vector<Vertex>> generators;
+
+        Partition unpack(const Coloring &colors)
+        {
+            work += vertex_num;
+            Partition partition{vector<Vertex>(vertex_num), vector<uint32_t>(vertex_num), colors.cell_of, vector<uint32_t>(vertex_num, 0), colors.cell_num};
+            // The sizes of the cells, then their ends
+            auto &filled = partition.cell_end;
+            for (Vertex v = 0; v < vertex_num; v++)
+            {
+                auto start = colors.cell_of[v];
+                partition.position[v] = start + filled[start]++;
+                partition.elements[partition.position[v]] = v;
+            }
+            for (uint32_t start = 0; start < vertex_num; start++)
+                if (filled[start] > 0)
+                    filled[start] += start;
+            return partition;
+        }
+
+        /**
+         * @brief Split the cell at `start` by the number of neighbours in the splitter, counted for the vertices in [first, last) and zero for the others.
+         * The pieces are ordered by that number, so that the result does not depend on vertex names.
+         *
+         * Hopcroft's rule: if the cell is waiting to be a splitter, so do all its pieces; otherwise all the pieces but the largest become splitters.
+         */
+        void split(Partition &partition, uint32_t start, vector<Vertex>::iterator first, vector<Vertex>::iterator last, deque<uint32_t> &splitters)
+        {
+            uint32_t end = partition.cell_end[start];
+            // The counted vertices move to the back of the cell by increasing count; the others stay in front.
+            uint32_t back = end;
+            for (auto it = last; it != first;)
+            {
+                Vertex v = *--it;
+                Vertex other = partition.elements[--back];
+                partition.elements[partition.position[v]] = other;
+                partition.position[other] = partition.position[v];
+                partition.elements[back] = v;
+                partition.position[v] = back;
+            }
+            vector<uint32_t> piece_starts;
+            if (back > start)
+                piece_starts.push_back(start);
+            for (uint32_t i = back; i < end; i++)
+                if (i == back || neighbor_count[partition.elements[i]] != neighbor_count[partition.elements[i - 1]])
+                    piece_starts.push_back(i);
+            if (piece_starts.size() == 1)
+                return;
+            piece_starts.push_back(end);
+
+            size_t largest = 0;
+            for (size_t k = 1; k + 1 < piece_starts.size(); k++)
+                if (piece_starts[k + 1] - piece_starts[k] > piece_starts[largest + 1] - piece_starts[largest])
+                    largest = k;
+            bool was_queued = queued[start];
+            for (size_t k = 0; k + 1 < piece_starts.size(); k++)
+            {
+                uint32_t piece = piece_starts[k];
+                partition.cell_end[piece] = piece_starts[k + 1];
+                // The first piece keeps the colour of the cell, and the others only hold counted vertices.
+                if (k > 0)
+                    for (uint32_t i = piece; i < piece_starts[k + 1]; i++)
+                        partition.cell_of[partition.elements[i]] = piece;
+                if ((was_queued || k != largest) && !queued[piece])
+                {
+                    queued[piece] = true;
+                    splitters.push_back(piece);
+                }
+            }
+            partition.cell_num += piece_starts.size() - 2;
+        }
+
+        /**
+         * @brief Split cells by the number of neighbours in each splitter cell until the colouring is equitable. Only cells adjacent to a splitter are visited,
+         * so that a refinement costs O((V + E) log V). Only depends on the colouring, not on vertex names.
+         *
+         * @param splitters the cells to split by: all of them, or the new cells if the rest of the colouring is already equitable
+         */
+        Coloring refine(Partition partition, const vector<uint32_t> &initial_splitters)
+        {
+            deque<uint32_t> splitters(initial_splitters.begin(), initial_splitters.end());
+            for (auto start : initial_splitters)
+                queued[start] = true;
+            vector<Vertex> counted;
+            while (!splitters.empty())
+            {
+                uint32_t splitter = splitters.front();
+                splitters.pop_front();
+                queued[splitter] = false;
+                if (partition.cell_num == vertex_num)
+                    continue;
+
+                counted.clear();
+                for (uint32_t i = splitter; i < partition.cell_end[splitter]; i++)
+                    for (auto u : adjacency[partition.elements[i]])
+                        if (neighbor_count[u]++ == 0)
+                            counted.push_back(u);
+                // By cell, in order, then by count
+                sort(counted.begin(), counted.end(), [&](Vertex lhs, Vertex rhs)
+                     { return partition.cell_of[lhs] != partition.cell_of[rhs] ? partition.cell_of[lhs] < partition.cell_of[rhs] : neighbor_count[lhs] < neighbor_count[rhs]; });
+                work += partition.cell_end[splitter] - splitter + counted.size();
+                for (size_t begin = 0, end; begin < counted.size(); begin = end)
+                {
+                    uint32_t start = partition.cell_of[counted[begin]];
+                    for (end = begin; end < counted.size() && partition.cell_of[counted[end]] == start; end++)
+                        ;
+                    split(partition, start, counted.begin() + begin, counted.begin() + end, splitters);
+                }
+                for (auto u : counted)
+                    neighbor_count[u] = 0;
+            }
+            return {std::move(partition.cell_of), partition.cell_num};
+        }
+
+        /**
+         * @brief `v` keeps its colour alone; the rest of its cell moves to the next colour. Then refine, by the new singleton cell only.
+         *
+         */
+        Coloring individualize(const Coloring &colors, Vertex v)
+        {
+            auto partition = unpack(colors);
+            uint32_t start = partition.cell_of[v], end = partition.cell_end[start];
+            Vertex other = partition.elements[start];
+            partition.elements[partition.position[v]] = other;
+            partition.position[other] = partition.position[v];
+            partition.elements[start] = v;
+            partition.position[v] = start;
+            for (uint32_t i = start + 1; i < end; i++)
+                partition.cell_of[partition.elements[i]] = start + 1;
+            partition.cell_end[start] = start + 1;
+            partition.cell_end[start + 1] = end;
+            partition.cell_num++;
+            return refine(std::move(partition), {start});
+        }
+
+        /**
+         * @brief The first non-singleton cell
+         *
+         */
+        vector<Vertex> target_cell(const Coloring &colors)
+        {
+            work += vertex_num;
+            vector<uint32_t> cell_size(vertex_num);
+            for (auto start : colors.cell_of)
+                cell_size[start]++;
+            auto target = find_if(cell_size.begin(), cell_size.end(), [](size_t size)
+                                  { return size > 1; });
+            vector<Vertex> cell;
+            for (Vertex v = 0; v < vertex_num; v++)
+                if (colors.cell_of[v] == static_cast<uint32_t>(target - cell_size.begin()))
+                    cell.push_back(v);
+            return cell;
+        }
+
+        bool is_automorphism(const vector<Vertex> &gamma)
+        {
+            vector<Vertex> image;
+            for (Vertex v = 0; v < vertex_num; v++)
+            {
+                work += adjacency[v].size();
+                image.clear();
+                for (auto u : adjacency[v])
+                    image.push_back(gamma[u]);
+                sort(image.begin(), image.end());
+                if (image != adjacency[gamma[v]])
+                    return false;
+            }
+            return true;
+        }
+
+        Vertex find_orbit(Vertex v)
+        {
+            while (orbit_parent[v] != v)
+                v = orbit_parent[v] = orbit_parent[orbit_parent[v]];
+            return v;
+        }
+
+        /**
+         * @brief Descend from `colors` at `level` to a discrete colouring that maps the first leaf to an automorphism.
+         *
+         */
+        optional<vector<Vertex>> search_leaf(const Coloring &colors, size_t level, size_t &budget)
+        {
+            if (budget == 0 || work >= total_budget)
+                return nullopt;
+            budget--;
+            if (level + 1 == first_path.size())
+            {
+                vector<Vertex> gamma(vertex_num);
+                for (Vertex v = 0; v < vertex_num; v++)
+                    gamma[first_leaf[colors.cell_of[v]]] = v;
+                if (is_automorphism(gamma))
+                    return gamma;
+                return nullopt;
+            }
+            for (auto u : target_cell(colors))
+            {
+                auto next = individualize(colors, u);
+                if (next.cell_num != first_path[level + 1].cell_num)
+                    continue;
+                auto gamma = search_leaf(next, level + 1, budget);
+                if (gamma.has_value() || budget == 0 || work >= total_budget)
+                    return gamma;
+            }
+            return nullopt;
+        }
+
+    public:
+        AutomorphismSearch(const vector<vector<Vertex>> &adjacency)
+            : adjacency(adjacency), vertex_num(adjacency.size()), orbit_parent(adjacency.size()), neighbor_count(adjacency.size()), queued(adjacency.size())
+        {
+            iota(orbit_parent.begin(), orbit_parent.end(), 0);
+        }
+
+        /**
+         * @param initial_colors the colour of each vertex, from 0 on
+         */
+        vector<vector<Vertex>> run(const vector<uint32_t> &initial_colors)
+        {
+            // Cells in the order of the colours
+            vector<uint32_t> cell_start(vertex_num + 1, 0);
+            for (auto color : initial_colors)
+                cell_start[color + 1]++;
+            partial_sum(cell_start.begin(), cell_start.end(), cell_start.begin());
+            Coloring colors;
+            vector<uint32_t> splitters;
+            for (auto color : initial_colors)
+                colors.cell_of.push_back(cell_start[color]);
+            for (uint32_t color = 0; color < vertex_num; color++)
+                if (cell_start[color + 1] > cell_start[color])
+                    splitters.push_back(cell_start[color]);
+            colors.cell_num = splitters.size();
+            first_path.push_back(refine(unpack(colors), splitters));
+
+            while (first_path.back().cell_num < vertex_num)
+            {
+                // Without a complete first path, there is no leaf to map.
+                if (work >= total_budget)
+                    return generators;
+                auto v = target_cell(first_path.back()).front();
+                first_path_choice.push_back(v);
+                first_path.push_back(individualize(first_path.back(), v));
+            }
+            first_leaf.resize(vertex_num);
+            for (Vertex v = 0; v < vertex_num; v++)
+                first_leaf[first_path.back().cell_of[v]] = v;
+
+            for (size_t level = first_path_choice.size(); level-- > 0;)
+            {
+                auto v = first_path_choice[level];
+                for (auto w : target_cell(first_path[level]))
+                {
+                    if (work >= total_budget)
+                        return generators;
+                    if (find_orbit(w) == find_orbit(v))
+                        continue;
+                    auto next = individualize(first_path[level], w);
+                    if (next.cell_num != first_path[level + 1].cell_num)
+                        continue;
+                    size_t budget = branch_budget;
+                    auto gamma = search_leaf(next, level + 1, budget);
+                    if (!gamma.has_value())
+                        continue;
+                    for (Vertex u = 0; u < vertex_num; u++)
+                        orbit_parent[find_orbit(u)] = find_orbit(gamma.value()[u]);
+                    generators.push_back(std::move(gamma.value()));
+                }
+            }
+            return generators;
+        }
+    };
+}
+
+SymmetryBreaking break_symmetries(CNF &cnf, size_t &next_var_name)
+{
+    auto start = std::chrono::steady_clock::now();
+    SymmetryBreaking report;
+
+    // Literal vertex `2 * v + 1` is the negation of literal vertex `2 * v`. Clause vertices follow the literal vertices.
+    unordered_map<size_t, size_t> dense_id;
+    vector<size_t> names;
+    for (auto &clause : cnf)
+        for (auto &literal : clause)
+            if (dense_id.insert({literal.second, names.size()}).second)
+                names.push_back(literal.second);
+    size_t literal_vertex_num = 2 * names.size();
+
+    vector<vector<Vertex>> adjacency(literal_vertex_num + cnf.size());
+    for (size_t v = 0; v < literal_vertex_num; v++)
+        adjacency[v].push_back(v ^ 1);
+    for (size_t c = 0; c < cnf.size(); c++)
+    {
+        Vertex clause_vertex = literal_vertex_num + c;
+        for (auto &literal : cnf[c])
+        {
+            Vertex literal_vertex = 2 * dense_id[literal.second] + !literal.first;
+            adjacency[clause_vertex].push_back(literal_vertex);
+            adjacency[literal_vertex].push_back(clause_vertex);
+        }
+    }
+    for (auto &neighbors : adjacency)
+    {
+        sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    }
+
+    vector<uint32_t> initial_colors(adjacency.size(), 0);
+    fill(initial_colors.begin() + literal_vertex_num, initial_colors.end(), 1);
+
+    auto generators = AutomorphismSearch(adjacency).run(initial_colors);
+
+    auto literal_of = [&](Vertex vertex) -> pair<bool, size_t>
+    {
+        return {vertex % 2 == 0, names[vertex / 2]};
+    };
+    auto negate = [](pair<bool, size_t> literal) -> pair<bool, size_t>
+    {
+        return {!literal.first, literal.second};
+    };
+
+    // Lex-leader constraint `x <= sigma(x)` over the variables in order of appearance, with e_i meaning "the first i variables are equal".
+    for (auto &gamma : generators)
+    {
+        vector<size_t> support;
+        for (size_t v = 0; v < names.size() && support.size() < max_support; v++)
+            if (gamma[2 * v] != 2 * v)
+                support.push_back(v);
+        if (support.empty())
+            continue;
+        report.generator_num++;
+
+        optional<pair<bool, size_t>> prefix_equal;
+        for (size_t i = 0; i < support.size(); i++)
+        {
+            auto x = literal_of(2 * support[i]);
+            auto y = literal_of(gamma[2 * support[i]]);
+            vector<pair<bool, size_t>> prefix;
+            if (prefix_equal.has_value())
+                prefix.push_back(negate(prefix_equal.value()));
+
+            auto add = [&](vector<pair<bool, size_t>> clause)
+            {
+                clause.insert(clause.begin(), prefix.begin(), prefix.end());
+                cnf.push_back(std::move(clause));
+                report.clause_num++;
+            };
+            if (y == negate(x))
+            {
+                // x <= !x forces x to false, and the prefix can not be equal afterwards.
+                add({negate(x)});
+                break;
+            }
+            add({negate(x), y});
+            if (i + 1 == support.size())
+                break;
+            pair<bool, size_t> next_prefix_equal{true, next_var_name++};
+            add({negate(x), next_prefix_equal});
+            add({y, next_prefix_equal});
+            prefix_equal = next_prefix_equal;
+        }
+    }
+
+    report.time_cost = std::chrono::steady_clock::now() - start;
+    return report;
+}
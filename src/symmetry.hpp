@@ -0,0 +1,35 @@
+#include <vector>
+#include <chrono>
+#include "dimacs.hpp"
+
+#ifndef SYMMETRY
+#define SYMMETRY
+
+using namespace std;
+
+/**
+ * @brief Static symmetry breaking.
+ *
+ * The formula is turned into a coloured graph: one vertex per literal, one vertex per clause,
+ * an edge between each literal and its negation and between each clause and its literals.
+ * Generators of the automorphism group of this graph are symmetries of the formula.
+ * For each generator, lex-leader clauses are appended to the formula, which removes symmetric copies of the search space but keeps the formula satisfiable iff it was.
+ *
+ */
+struct SymmetryBreaking
+{
+    size_t generator_num = 0;
+    size_t clause_num = 0;
+    std::chrono::nanoseconds time_cost{0};
+};
+
+/**
+ * @brief Append symmetry-breaking clauses to `cnf`.
+ *
+ * @param cnf
+ * @param next_var_name auxiliary variables are named from `next_var_name` on; updated to the first unused name
+ * @return SymmetryBreaking
+ */
+SymmetryBreaking break_symmetries(CNF &cnf, size_t &next_var_name);
+
+#endif
@@ -25,4 +25,124 @@ VariableValue optional2variableValue(std::optional<bool> value)
 VariableValue bool2variableValue(bool value)
 {
     return static_cast<VariableValue>(value);
-}
\ No newline at end of file
+}
+
+size_t parallel_range_num(size_t thread_num, size_t size, size_t grain)
+{
+    return std::max<size_t>(1, std::min(thread_num, size / std::max<size_t>(grain, 1)));
+}
+
+uint64_t hash_mix(uint64_t value)
+{
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+uint64_t hash_combine(uint64_t seed, uint64_t value)
+{
+    return hash_mix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+}
+
+BigCount::BigCount(uint64_t value)
+{
+    while (value != 0)
+    {
+        digits.push_back(static_cast<uint32_t>(value));
+        value >>= 32;
+    }
+}
+
+BigCount &BigCount::operator+=(const BigCount &rhs)
+{
+    if (digits.size() < rhs.digits.size())
+        digits.resize(rhs.digits.size(), 0);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < digits.size(); i++)
+    {
+        uint64_t sum = carry + digits[i] + (i < rhs.digits.size() ? rhs.digits[i] : 0);
+        digits[i] = static_cast<uint32_t>(sum);
+        carry = sum >> 32;
+    }
+    if (carry != 0)
+        digits.push_back(static_cast<uint32_t>(carry));
+    return *this;
+}
+
+BigCount &BigCount::operator*=(const BigCount &rhs)
+{
+    if (is_zero() || rhs.is_zero())
+    {
+        digits.clear();
+        return *this;
+    }
+    std::vector<uint32_t> product(digits.size() + rhs.digits.size(), 0);
+    for (size_t i = 0; i < digits.size(); i++)
+    {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < rhs.digits.size(); j++)
+        {
+            uint64_t cur = uint64_t(digits[i]) * rhs.digits[j] + product[i + j] + carry;
+            product[i + j] = static_cast<uint32_t>(cur);
+            carry = cur >> 32;
+        }
+        product[i + rhs.digits.size()] = static_cast<uint32_t>(carry);
+    }
+    while (!product.empty() && product.back() == 0)
+        product.pop_back();
+    digits = std::move(product);
+    return *this;
+}
+
+BigCount &BigCount::operator<<=(size_t shift)
+{
+    if (is_zero())
+        return *this;
+    digits.insert(digits.begin(), shift / 32, 0);
+    shift %= 32;
+    if (shift != 0)
+    {
+        uint32_t carry = 0;
+        for (auto &digit : digits)
+        {
+            uint32_t next_carry = digit >> (32 - shift);
+            digit = (digit << shift) | carry;
+            carry = next_carry;
+        }
+        if (carry != 0)
+            digits.push_back(carry);
+    }
+    return *this;
+}
+
+std::string BigCount::to_string() const
+{
+    if (is_zero())
+        return "0";
+    // Repeated division by 10^9
+    std::vector<uint32_t> rest(digits);
+    std::vector<uint32_t> chunks;
+    while (!rest.empty())
+    {
+        uint64_t remainder = 0;
+        for (size_t i = rest.size(); i-- > 0;)
+        {
+            uint64_t cur = (remainder << 32) | rest[i];
+            rest[i] = static_cast<uint32_t>(cur / 1000000000);
+            remainder = cur % 1000000000;
+        }
+        chunks.push_back(static_cast<uint32_t>(remainder));
+        while (!rest.empty() && rest.back() == 0)
+            rest.pop_back();
+    }
+    std::string result = std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;)
+    {
+        auto chunk = std::to_string(chunks[i]);
+        result += std::string(9 - chunk.size(), '0') + chunk;
+    }
+    return result;
+}
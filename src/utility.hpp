@@ -2,6 +2,14 @@
 #include <optional>
 #include <string>
 #include <chrono>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <algorithm>
+
+#ifndef UTILITY
+#define UTILITY
 
 #define claim(X)                                        \
     {                                                   \
@@ -25,4 +33,76 @@ std::optional<bool> variableValue2optional(VariableValue variableValue);
 
 VariableValue optional2variableValue(std::optional<bool> value);
 
-VariableValue bool2variableValue(bool value);
\ No newline at end of file
+VariableValue bool2variableValue(bool value);
+
+uint64_t hash_mix(uint64_t value);
+
+uint64_t hash_combine(uint64_t seed, uint64_t value);
+
+/**
+ * @brief Unsigned integer of arbitrary size, for model counts.
+ *
+ */
+class BigCount
+{
+    // Little-endian base-2^32 digits, without leading zeros
+    std::vector<uint32_t> digits;
+
+public:
+    BigCount(uint64_t value = 0);
+
+    bool is_zero() const
+    {
+        return digits.empty();
+    }
+
+    BigCount &operator+=(const BigCount &rhs);
+    BigCount &operator*=(const BigCount &rhs);
+    BigCount &operator<<=(size_t shift);
+
+    bool operator==(const BigCount &rhs) const
+    {
+        return digits == rhs.digits;
+    }
+
+    std::string to_string() const;
+};
+
+/**
+ * @brief The number of ranges `parallel_for` should split `size` elements into: at most `thread_num`, of at least `grain` elements each.
+ *
+ */
+size_t parallel_range_num(size_t thread_num, size_t size, size_t grain);
+
+/**
+ * @brief Split [0, size) into `range_num` contiguous ranges, and call `f(range, begin, end)` for each of them on its own thread.
+ * The first range runs on the calling thread. An exception thrown by `f` is rethrown once all the ranges are done.
+ *
+ */
+template <typename F>
+void parallel_for(size_t range_num, size_t size, F &&f)
+{
+    std::vector<std::exception_ptr> errors(range_num);
+    auto run = [&](size_t range)
+    {
+        try
+        {
+            f(range, size * range / range_num, size * (range + 1) / range_num);
+        }
+        catch (...)
+        {
+            errors[range] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t range = 1; range < range_num; range++)
+        threads.emplace_back(run, range);
+    run(0);
+    for (auto &thread : threads)
+        thread.join();
+    for (auto &error : errors)
+        if (error)
+            std::rethrow_exception(error);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include <map>
+#include "sat_solver.hpp"
+#include "policy_registry.hpp"
+
+namespace
+{
+    bool test_bit(const uint64_t *words, size_t i)
+    {
+        return (words[i / 64] >> (i % 64)) & 1;
+    }
+
+    size_t popcount_and(const uint64_t *lhs, const uint64_t *rhs, size_t word_num)
+    {
+        size_t count = 0;
+        for (size_t w = 0; w < word_num; w++)
+            count += __builtin_popcountll(lhs[w] & rhs[w]);
+        return count;
+    }
+}
+
+/**
+ * @brief The XOR of k variables with parity p forbids the 2^(k-1) assignments of parity !p.
+ * Each clause over exactly these variables forbids one assignment: the one making all its literals false.
+ *
+ */
+template <typename Policies>
+size_t BasicSATSolver<Policies>::XorPropagator::detect(size_t max_size)
+{
+    // sorted variables -> forbidden assignments, as bitmasks over the sorted variables
+    map<vector<VariableID>, unordered_set<uint32_t>> forbidden;
+    for (auto &clause : sat_solver.clauses)
+    {
+        auto &literals = clause.get_literals();
+        if (literals.size() < 2 || literals.size() > max_size)
+            continue;
+        vector<VariableID> variables;
+        for (auto &varID_literal : literals)
+            variables.push_back(varID_literal.first);
+        sort(variables.begin(), variables.end());
+        uint32_t assignment = 0;
+        for (size_t i = 0; i < variables.size(); i++)
+            if (!literals.at(variables[i]).get_literal_type())
+                assignment |= 1u << i;
+        forbidden[variables].insert(assignment);
+    }
+
+    vector<pair<vector<VariableID>, bool>> xors;
+    for (auto &variables_assignments : forbidden)
+    {
+        auto &variables = variables_assignments.first;
+        array<size_t, 2> count_by_parity{0, 0};
+        for (auto assignment : variables_assignments.second)
+            count_by_parity[__builtin_popcount(assignment) % 2]++;
+        for (size_t parity = 0; parity < 2; parity++)
+            if (count_by_parity[!parity] == (size_t(1) << (variables.size() - 1)))
+                xors.push_back({variables, parity});
+    }
+
+    unordered_map<VariableID, size_t> column_of;
+    for (auto &xor_constraint : xors)
+        for (auto var_id : xor_constraint.first)
+            if (column_of.insert({var_id, columns.size()}).second)
+                columns.push_back(var_id);
+    word_num = (columns.size() + 63) / 64;
+    rows.assign(xors.size() * word_num, 0);
+    for (size_t r = 0; r < xors.size(); r++)
+    {
+        for (auto var_id : xors[r].first)
+        {
+            auto column = column_of[var_id];
+            rows[r * word_num + column / 64] |= uint64_t(1) << (column % 64);
+        }
+        parities.push_back(xors[r].second);
+    }
+    pivot_columns.assign(xors.size(), no_pivot);
+    last_unassigned_mask.clear();
+    last_true_mask.clear();
+    return xors.size();
+}
+
+template <typename Policies>
+auto BasicSATSolver<Policies>::XorPropagator::propagate() -> optional<ClauseID>
+{
+    vector<uint64_t> unassigned_mask(word_num, 0), true_mask(word_num, 0);
+    for (size_t column = 0; column < columns.size(); column++)
+    {
+        auto value = sat_solver.get_variable(columns[column]).value;
+        if (value == UNASSIGNED)
+            unassigned_mask[column / 64] |= uint64_t(1) << (column % 64);
+        else if (value == TRUE)
+            true_mask[column / 64] |= uint64_t(1) << (column % 64);
+    }
+    // Nothing has changed since the last elimination, which derived nothing.
+    if (unassigned_mask == last_unassigned_mask && true_mask == last_true_mask)
+        return nullopt;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t row_num = parities.size();
+
+    // Gauss-Jordan elimination, resumed from the last one: only the rows whose pivot has been assigned since, or which had none, are pivoted
+    // on one of their unassigned columns. Those are not the pivots of other rows, which appear in no other row.
+    // Assigned columns are kept in the rows to build the reasons.
+    for (size_t r = 0; r < row_num; r++)
+    {
+        if (pivot_columns[r] != no_pivot && test_bit(unassigned_mask.data(), pivot_columns[r]))
+            continue;
+        pivot_columns[r] = no_pivot;
+        const uint64_t *pivot_row = &rows[r * word_num];
+        for (size_t w = 0; w < word_num && pivot_columns[r] == no_pivot; w++)
+            if (auto candidates = pivot_row[w] & unassigned_mask[w])
+                pivot_columns[r] = w * 64 + __builtin_ctzll(candidates);
+        if (pivot_columns[r] == no_pivot)
+            continue;
+        auto column = pivot_columns[r];
+        for (size_t other = 0; other < row_num; other++)
+        {
+            if (other == r || !test_bit(&rows[other * word_num], column))
+                continue;
+            uint64_t *row = &rows[other * word_num];
+            for (size_t w = 0; w < word_num; w++)
+                row[w] ^= pivot_row[w];
+            parities[other] = parities[other] != parities[r];
+        }
+    }
+
+    // The literals of the variables of `row` which are false under the current assignment
+    auto false_literals = [&](const uint64_t *row)
+    {
+        vector<pair<VariableID, bool>> literals;
+        for (size_t column = 0; column < columns.size(); column++)
+            if (test_bit(row, column) && !test_bit(unassigned_mask.data(), column))
+                literals.push_back({columns[column], !test_bit(true_mask.data(), column)});
+        return literals;
+    };
+
+    auto explain = [&](const vector<pair<VariableID, bool>> &literals)
+    {
+        auto clause_id = sat_solver.add_implied_clause(literals);
+        // The number of literals bounds the LBD.
+        sat_solver.reduction_policy.on_learnt(clause_id, literals.size(), literals.size());
+        return clause_id;
+    };
+
+    optional<ClauseID> conflict;
+    bool derived = false;
+    for (size_t r = 0; r < row_num && !conflict.has_value(); r++)
+    {
+        const uint64_t *row = &rows[r * word_num];
+        size_t unassigned_num = popcount_and(row, unassigned_mask.data(), word_num);
+        if (unassigned_num > 1)
+            continue;
+        bool assigned_parity = popcount_and(row, true_mask.data(), word_num) % 2;
+        if (unassigned_num == 0)
+        {
+            if (assigned_parity != parities[r])
+                conflict = explain(false_literals(row));
+            continue;
+        }
+        size_t column = 0;
+        while (!(test_bit(row, column) && test_bit(unassigned_mask.data(), column)))
+            column++;
+        auto reason = false_literals(row);
+        reason.push_back({columns[column], assigned_parity != parities[r]});
+        explain(reason);
+        derived = true;
+    }
+
+    if (!conflict.has_value() && !derived)
+    {
+        last_unassigned_mask = std::move(unassigned_mask);
+        last_true_mask = std::move(true_mask);
+    }
+    sat_solver.statistic.xor_elimination_time += std::chrono::steady_clock::now() - start;
+    return conflict;
+}
+
+#define SAT_INSTANTIATE(Decision, Restart, Reduction, Phase)                                                          \
+    template size_t BasicSATSolver<SolverPolicies<Decision, Restart, Reduction, Phase>>::XorPropagator::detect(size_t); \
+    template auto BasicSATSolver<SolverPolicies<Decision, Restart, Reduction, Phase>>::XorPropagator::propagate()->optional<ClauseID>;
+SAT_REGISTERED_POLICIES(SAT_INSTANTIATE)
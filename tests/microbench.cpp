@@ -0,0 +1,437 @@
+/**
+ * @brief Microbenchmarks of the solver kernels: parsing, unipropagation, conflict analysis and backjumping.
+ *
+ * Usage: microbench [--cnf file] [--vars N] [--clauses N] [--seed N] [--min-time ms]
+ *
+ * Without --cnf, a random 3-CNF of the given size is generated. The results are written to stdout as JSON.
+ * Cache misses are read from perf_event_open when the kernel allows it, and reported as null otherwise.
+ *
+ */
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <random>
+#include <atomic>
+#include <new>
+#include <memory>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "sat_solver.hpp"
+#include "dimacs.hpp"
+
+using namespace std::chrono;
+
+namespace
+{
+    std::atomic<size_t> allocation_num{0};
+}
+
+void *operator new(size_t size)
+{
+    allocation_num.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace
+{
+    class PerfCounter
+    {
+        int fd = -1;
+
+    public:
+        PerfCounter(uint32_t type, uint64_t config)
+        {
+            perf_event_attr attr{};
+            attr.type = type;
+            attr.size = sizeof(attr);
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+
+        ~PerfCounter()
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+
+        bool available() const
+        {
+            return fd >= 0;
+        }
+
+        void start()
+        {
+            if (fd < 0)
+                return;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+
+        uint64_t stop()
+        {
+            if (fd < 0)
+                return 0;
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t value = 0;
+            if (read(fd, &value, sizeof(value)) != sizeof(value))
+                return 0;
+            return value;
+        }
+    };
+
+    string json_string(const string &text)
+    {
+        string quoted = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                quoted += {'\\', c};
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char escape[7];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                quoted += escape;
+            }
+            else
+                quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    /**
+     * @brief Accumulates time, cache misses and allocations over the timed sections of a kernel.
+     *
+     */
+    class Meter
+    {
+        PerfCounter cache_misses{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+        steady_clock::time_point section_start;
+        size_t section_allocations = 0;
+
+    public:
+        string name;
+        size_t ops = 0;
+        nanoseconds time{0};
+        uint64_t cache_miss_num = 0;
+        size_t allocations = 0;
+        // Kernel-specific averages, e.g. assignments per replay
+        vector<pair<string, double>> extra;
+
+        Meter(string name) : name(std::move(name)) {}
+
+        void start()
+        {
+            section_allocations = allocation_num.load(std::memory_order_relaxed);
+            cache_misses.start();
+            section_start = steady_clock::now();
+        }
+
+        void stop(size_t op_num = 1)
+        {
+            auto end = steady_clock::now();
+            cache_miss_num += cache_misses.stop();
+            allocations += allocation_num.load(std::memory_order_relaxed) - section_allocations;
+            time += end - section_start;
+            ops += op_num;
+        }
+
+        string to_json() const
+        {
+            ostringstream json;
+            double op_num = max<size_t>(ops, 1);
+            json << "{\"name\": " << json_string(name) << ", \"ops\": " << ops
+                 << ", \"ns_per_op\": " << time.count() / op_num
+                 << ", \"cache_misses_per_op\": ";
+            if (cache_misses.available())
+                json << cache_miss_num / op_num;
+            else
+                json << "null";
+            json << ", \"allocations_per_op\": " << allocations / op_num;
+            for (auto &name_value : extra)
+                json << ", \"" << name_value.first << "\": " << name_value.second;
+            json << "}";
+            return json.str();
+        }
+    };
+
+    string random_cnf(size_t var_num, size_t clause_num, mt19937_64 &random)
+    {
+        ostringstream text;
+        text << "p cnf " << var_num << " " << clause_num << "\n";
+        uniform_int_distribution<long long> variable(1, var_num);
+        for (size_t c = 0; c < clause_num; c++)
+        {
+            for (size_t i = 0; i < 3; i++)
+                text << (random() % 2 ? 1 : -1) * variable(random) << " ";
+            text << "0\n";
+        }
+        return text.str();
+    }
+}
+
+/**
+ * @brief Friend of SATSolver: drives its private kernels.
+ *
+ */
+class MicroBenchmark
+{
+    const CNF &cnf;
+    nanoseconds min_time;
+    // The recorded trail: decisions are replayed in this order.
+    vector<pair<size_t, bool>> decisions;
+    ostream null_log{nullptr};
+
+    unique_ptr<SATSolver> make_solver()
+    {
+        auto sat_solver = make_unique<SATSolver>(null_log);
+        sat_solver->initiate(cnf.begin(), cnf.end());
+        claim(!sat_solver->unipropagate().has_value());
+        return sat_solver;
+    }
+
+    /**
+     * @brief Replay the trail until a conflict or the end of the trail.
+     *
+     * @return optional<SATSolver::ClauseID> the conflict clause
+     */
+    optional<SATSolver::ClauseID> replay(SATSolver &sat_solver)
+    {
+        for (auto &decision : decisions)
+        {
+            auto var_id = sat_solver.OriginalName2varID.at(decision.first);
+            if (sat_solver.get_variable(var_id).value != UNASSIGNED)
+                continue;
+            claim(!sat_solver.assign(var_id, decision.second).has_value());
+            sat_solver.implication_graph.push_decision_node(var_id);
+            auto conflict = sat_solver.unipropagate();
+            if (conflict.has_value())
+                return conflict;
+        }
+        return nullopt;
+    }
+
+    bool enough(const Meter &meter) const
+    {
+        return meter.time >= min_time;
+    }
+
+public:
+    MicroBenchmark(const CNF &cnf, nanoseconds min_time, mt19937_64 &random) : cnf(cnf), min_time(min_time)
+    {
+        unordered_set<size_t> names;
+        for (auto &clause : cnf)
+            for (auto &literal : clause)
+                if (names.insert(literal.second).second)
+                    decisions.push_back({literal.second, random() % 2 == 0});
+        shuffle(decisions.begin(), decisions.end(), random);
+    }
+
+    /**
+     * @brief Whether unipropagation at level 0 ends without a conflict. Otherwise the formula is UNSAT and there is no trail to replay.
+     *
+     */
+    bool is_replayable()
+    {
+        SATSolver sat_solver(null_log);
+        sat_solver.initiate(cnf.begin(), cnf.end());
+        return !sat_solver.unipropagate().has_value();
+    }
+
+    Meter parse(const string &text)
+    {
+        Meter meter("DIMACS2vec");
+        size_t clause_num = 0;
+        while (!enough(meter))
+        {
+            istringstream input(text);
+            meter.start();
+            auto res = DIMACS2vec(input);
+            meter.stop(res.first.size());
+            clause_num = res.first.size();
+        }
+        meter.extra.push_back({"clauses_per_parse", static_cast<double>(clause_num)});
+        return meter;
+    }
+
+    Meter unipropagate()
+    {
+        Meter meter("unipropagate");
+        auto sat_solver = make_solver();
+        size_t assignments = 0, replays = 0;
+        while (!enough(meter))
+        {
+            size_t ops = meter.ops;
+            for (auto &decision : decisions)
+            {
+                auto var_id = sat_solver->OriginalName2varID.at(decision.first);
+                if (sat_solver->get_variable(var_id).value != UNASSIGNED)
+                    continue;
+                claim(!sat_solver->assign(var_id, decision.second).has_value());
+                sat_solver->implication_graph.push_decision_node(var_id);
+                size_t before = sat_solver->implication_graph.size();
+                meter.start();
+                auto conflict = sat_solver->unipropagate();
+                meter.stop();
+                assignments += sat_solver->implication_graph.size() - before;
+                if (conflict.has_value())
+                    break;
+            }
+            sat_solver->backtrack(0);
+            replays++;
+            // Every variable is assigned at level 0: there is nothing to time.
+            if (meter.ops == ops)
+                break;
+        }
+        meter.extra.push_back({"assignments_per_op", assignments / double(max<size_t>(meter.ops, 1))});
+        meter.extra.push_back({"replays", static_cast<double>(replays)});
+        return meter;
+    }
+
+    /**
+     * @brief The recorded conflicts are those met when replaying rotations of the trail.
+     *
+     */
+    Meter conflict_analysis()
+    {
+        Meter meter("ImplicationGraph::confilict_analysis");
+        auto sat_solver = make_solver();
+        size_t learnt_size = 0;
+        for (size_t rotation = 0; !enough(meter); rotation = (rotation + 1) % max<size_t>(decisions.size(), 1))
+        {
+            rotate(decisions.begin(), decisions.begin() + (decisions.empty() ? 0 : 1), decisions.end());
+            auto conflict = replay(*sat_solver);
+            if (conflict.has_value() && sat_solver->implication_graph.get_decision_level() > 0)
+            {
+                meter.start();
+                auto learnt = sat_solver->implication_graph.confilict_analysis(conflict.value());
+                meter.stop();
+                learnt_size += learnt.size();
+            }
+            sat_solver->backtrack(0);
+            // No rotation meets a conflict, or there is no decision at all
+            if (meter.ops == 0 && rotation + 1 >= decisions.size())
+                break;
+        }
+        meter.extra.push_back({"learnt_literals_per_op", learnt_size / double(max<size_t>(meter.ops, 1))});
+        return meter;
+    }
+
+    Meter backjump()
+    {
+        Meter meter("backjump");
+        auto sat_solver = make_solver();
+        size_t undone = 0;
+        for (size_t rotation = 0; !enough(meter); rotation = (rotation + 1) % max<size_t>(decisions.size(), 1))
+        {
+            rotate(decisions.begin(), decisions.begin() + (decisions.empty() ? 0 : 1), decisions.end());
+            auto conflict = replay(*sat_solver);
+            auto level = sat_solver->implication_graph.get_decision_level();
+            if (conflict.has_value() && level > 0)
+            {
+                // Jump to the level the solver would: the second highest level of the learnt clause.
+                auto learnt = sat_solver->implication_graph.confilict_analysis(conflict.value());
+                size_t target = 0;
+                for (size_t i = 1; i < learnt.size(); i++)
+                    target = max(target, sat_solver->implication_graph[learnt[i]].decision_level);
+                size_t before = sat_solver->implication_graph.size();
+                meter.start();
+                sat_solver->backtrack(target);
+                meter.stop();
+                undone += before - sat_solver->implication_graph.size();
+            }
+            sat_solver->backtrack(0);
+            // No rotation meets a conflict, or there is no decision at all
+            if (meter.ops == 0 && rotation + 1 >= decisions.size())
+                break;
+        }
+        meter.extra.push_back({"assignments_undone_per_op", undone / double(max<size_t>(meter.ops, 1))});
+        return meter;
+    }
+};
+
+int main(int argc, const char *argv[])
+{
+    vector<string> args(argv + 1, argv + argc);
+    string cnf_file;
+    size_t var_num = 200, clause_num = 852, seed = 1;
+    milliseconds min_time(200);
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+        if (args[i] == "--cnf")
+            cnf_file = args[i + 1];
+        else if (args[i] == "--vars")
+            var_num = stoul(args[i + 1]);
+        else if (args[i] == "--clauses")
+            clause_num = stoul(args[i + 1]);
+        else if (args[i] == "--seed")
+            seed = stoul(args[i + 1]);
+        else if (args[i] == "--min-time")
+            min_time = milliseconds(stoul(args[i + 1]));
+        else
+        {
+            cerr << "Usage: microbench [--cnf file] [--vars N] [--clauses N] [--seed N] [--min-time ms]\n";
+            return -1;
+        }
+    }
+    if (args.size() % 2 != 0)
+    {
+        cerr << "Usage: microbench [--cnf file] [--vars N] [--clauses N] [--seed N] [--min-time ms]\n";
+        return -1;
+    }
+
+    mt19937_64 random(seed);
+    string text;
+    if (cnf_file.empty())
+        text = random_cnf(var_num, clause_num, random);
+    else
+    {
+        ifstream input(cnf_file);
+        if (!input)
+        {
+            cerr << "Failed to open input file" << endl;
+            return -1;
+        }
+        text.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    }
+    istringstream input(text);
+    auto cnf = DIMACS2vec(input).first;
+
+    MicroBenchmark benchmark(cnf, min_time, random);
+    if (!benchmark.is_replayable())
+    {
+        cerr << "The input is UNSAT by unipropagation alone: there is no trail to replay" << endl;
+        return -1;
+    }
+    vector<Meter> results;
+    results.push_back(benchmark.parse(text));
+    results.push_back(benchmark.unipropagate());
+    results.push_back(benchmark.conflict_analysis());
+    results.push_back(benchmark.backjump());
+
+    cout << "{\n  \"input\": " << json_string(cnf_file.empty() ? "random" : cnf_file) << ",\n"
+         << "  \"clauses\": " << cnf.size() << ",\n"
+         << "  \"seed\": " << seed << ",\n"
+         << "  \"kernels\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+        cout << "    " << results[i].to_json() << (i + 1 < results.size() ? ",\n" : "\n");
+    cout << "  ]\n}" << endl;
+}